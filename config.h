@@ -25,6 +25,12 @@
 
 #define VERSION "1.0"
 
+#ifdef KS_LIB
+#define verbose ks_verbose
+#endif
+	/* libkscrypt keeps its own, so that it doesn't take the name
+	   from programs linked with it */
+
 extern short verbose;
 	/* is set in main() and affect verbosity of all routines */
 
@@ -23,13 +23,31 @@
 
 #include "ks_crypt.h"
 #include "uint1024.h"
+#include "ks_io.h"
 #include "config.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
+#include <pthread.h>
 
 char *in_fn, *out_fn, *key_fn="private-key";
 	/* files with key, input file & output file */
+ks_ctx *ctx;
+	/* the private key */
+int tables=1;
+	/* decrypt with precomputed subset sums of private key */
+int comb=-1;
+	/* bits of ciphertext per window of multiplication tables, 0 = no
+	   tables, -1 = tables only if m is even */
+int threads=1;
+	/* number of decrypting threads */
+
+#define BLK (4*__SZ1024_32)
+	/* bytes of encrypted block */
+#define BATCH 64
+	/* blocks read at once */
 
 void init(char *pn);			/* prints stuff about prog&author */
 void warranty(void);			/* warranty - cut&pasted from GPL */
@@ -43,11 +61,14 @@ int parse_args(int argc, char *argv[]) {
 		{ "warranty", 0, 0, 'w'},
 		{ "help", 0, 0, 0},
 		{ "key-file", 1, 0, 'k'},
+		{ "tables", 1, 0, 'T'},
+		{ "comb", 1, 0, 'C'},
+		{ "threads", 1, 0, 't'},
 		{ 0, 0, 0, 0}
 	};
 
 	while (1) {
-		c = getopt_long (argc, argv, "qwv::k:", 
+		c = getopt_long (argc, argv, "qwv::k:T:C:t:", 
 				 long_options, &opt_ix);
 
 		if (c==-1) break;
@@ -79,6 +100,30 @@ int parse_args(int argc, char *argv[]) {
 		    
 		  case 'k': key_fn=optarg; break;
 
+		  case 'T':
+		    if (sscanf(optarg,"%d", &tables)!=1 || tables<0 || tables>1) {
+			    fprintf(stderr,"Invalid argument for --tables: %s\n",
+					    optarg);
+			    return(1);
+		    }
+		    break;
+
+		  case 't':
+		    if (sscanf(optarg,"%d", &threads)!=1 || threads<1) {
+			    fprintf(stderr,"Invalid argument for --threads: %s\n",
+					    optarg);
+			    return(1);
+		    }
+		    break;
+
+		  case 'C':
+		    if (sscanf(optarg,"%d", &comb)!=1 || comb<-1 || comb>10) {
+			    fprintf(stderr,"Invalid argument for --comb: %s\n",
+					    optarg);
+			    return(1);
+		    }
+		    break;
+
 		  case '?':
 		    return(1);
 	  	  default:
@@ -103,20 +148,234 @@ int parse_args(int argc, char *argv[]) {
 }
 
 
+/*
+ * plaintext of the last block read, written after r is known
+ */
+uint8_t last[ITEMS/8];
+int have;
+
+/*
+ * writes n blocks of plaintext to fo, all but the last one, which is
+ * kept in last instead of the one kept before
+ * returns non-zero if failed
+ */
+int write_batch(ks_file_t *fo, const uint8_t *plain, int n) {
+	uint8_t *p;
+
+	if (have) {
+		if (!(p=ks_wbuf(fo, ITEMS/8))) return(1);
+		memcpy(p, last, ITEMS/8);
+	}
+	if (n>1) {
+		if (!(p=ks_wbuf(fo, (n-1)*ITEMS/8))) return(1);
+		memcpy(p, plain, (n-1)*ITEMS/8);
+	}
+	memcpy(last, plain+(n-1)*ITEMS/8, ITEMS/8);
+	have = 1;
+	return(0);
+}
+
+/*
+ * decrypts n blocks of ciphertext from src to out
+ */
+void decrypt_batch(const uint8_t *src, int n, uint8_t *out) {
+	uint1024 d[BATCH];
+	int i;
+
+	for (i=0; i<n; i++) load1024(src+i*BLK, d[i]);
+	ks_decryptn(ctx, d, n, out);
+}
+
+
+/*
+ * --threads: if both input and output are mapped, workers take batches
+ * of blocks one after another and decrypt them straight to their place
+ * in the output; otherwise main() reads batches into a ring of slots,
+ * workers decrypt them in any order and writer() stores them in the
+ * order they were read
+ */
+struct slot {
+	const uint8_t	*src;		/* batch in mapped input or data */
+	uint8_t		data[BATCH*BLK];
+	uint8_t		plain[BATCH*ITEMS/8];
+	int		n;		/* blocks in batch */
+	int		state;
+};
+
+enum { SLOT_FREE, SLOT_READ, SLOT_DONE };
+
+struct slot *slots;
+int nslots;
+int seq_read, seq_work, seq_end=-1;
+	/* batches read, taken by workers, total (-1 until EOF) */
+int write_err;
+	/* writer() failed, everyone stops */
+const uint8_t *map_src;
+uint8_t *map_out;
+int map_blocks;
+	/* mapped input and output (if both are), blocks to decrypt there */
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+void *worker(void *arg) {
+	struct slot *p;
+	int s,n;
+
+	pthread_mutex_lock(&lock);
+	while (1) {
+		while (seq_work>=seq_read && seq_end<0 && !write_err)
+			pthread_cond_wait(&cond, &lock);
+		if (seq_work>=seq_read || write_err) break;
+
+		s = seq_work++;
+		pthread_mutex_unlock(&lock);
+		if (map_out) {
+			n = map_blocks - s*BATCH;
+			if (n>BATCH) n = BATCH;
+			decrypt_batch(map_src + (size_t) s*BATCH*BLK, n,
+					map_out + (size_t) s*BATCH*ITEMS/8);
+			pthread_mutex_lock(&lock);
+			continue;
+		}
+		p = &slots[s % nslots];
+		decrypt_batch(p->src, p->n, p->plain);
+		pthread_mutex_lock(&lock);
+		p->state = SLOT_DONE;
+		pthread_cond_broadcast(&cond);
+	}
+	pthread_mutex_unlock(&lock);
+	return(0);
+}
+
+void *writer(void *fo) {
+	struct slot *p;
+	int s,e;
+
+	pthread_mutex_lock(&lock);
+	for (s=0; ; s++) {
+		p = &slots[s % nslots];
+		while (p->state!=SLOT_DONE && (seq_end<0 || s<seq_end))
+			pthread_cond_wait(&cond, &lock);
+		if (p->state!=SLOT_DONE) break;
+
+		pthread_mutex_unlock(&lock);
+		e = write_batch(fo, p->plain, p->n);
+		pthread_mutex_lock(&lock);
+		p->state = SLOT_FREE;
+		pthread_cond_broadcast(&cond);
+		if (e) { write_err = 1; break; }
+	}
+	pthread_mutex_unlock(&lock);
+	return(0);
+}
+
+/*
+ * decrypts fi to fo using threads workers, rest is pointed to nrest
+ * bytes after the last block
+ * returns non-zero if threads can't be started; a write error stops
+ * it with write_err set
+ */
+int decrypt_threaded(ks_file_t *fi, ks_file_t *fo, const uint8_t **rest,
+		int *nrest) {
+	pthread_t *th;
+	struct slot *p;
+	const uint8_t *buf;
+	size_t n;
+	int i,k;
+
+	th = calloc(threads+1, sizeof(pthread_t));
+	if (!th) return(1);
+
+	if (fi->map && fo->map) {
+		/* all blocks but the last one, in place */
+		n = ks_read(fi, &buf, fi->size - fi->pos);
+		k = n/BLK;
+		*rest = buf + k*BLK; *nrest = n - k*BLK;
+		if (!k) { free(th); return(0); }
+
+		map_src = buf;
+		if (k>1 && (map_out = ks_wbuf(fo, (size_t) (k-1)*ITEMS/8))) {
+			map_blocks = k-1;
+			seq_end = seq_read = (k-1+BATCH-1)/BATCH;
+			for (i=1; i<=threads; i++)
+				if (pthread_create(&th[i], 0, worker, 0))
+					return(1);
+			for (i=1; i<=threads; i++) pthread_join(th[i], 0);
+		}
+		decrypt_batch(buf + (k-1)*BLK, 1, last);
+		have = 1;
+		free(th);
+		return(0);
+	}
+
+	nslots = 4*threads;
+	slots = calloc(nslots, sizeof(struct slot));
+	if (!slots) return(1);
+
+	if (pthread_create(&th[0], 0, writer, fo)) return(1);
+	for (i=1; i<=threads; i++)
+		if (pthread_create(&th[i], 0, worker, 0)) return(1);
+
+	while (1) {
+		p = &slots[seq_read % nslots];
+		pthread_mutex_lock(&lock);
+		while (p->state!=SLOT_FREE && !write_err)
+			pthread_cond_wait(&cond, &lock);
+		k = write_err;
+		pthread_mutex_unlock(&lock);
+
+		/* fo belongs to writer() now, its errors come as write_err */
+		if (k || fi->err) break;
+		n = ks_read(fi, &buf, BATCH*BLK);
+		p->n = n/BLK;
+		*rest = buf + p->n*BLK; *nrest = n - p->n*BLK;
+		if (!p->n) break;
+		p->src = buf;
+		/* buffered input is overwritten by the next read */
+		if (!fi->map) {
+			memcpy(p->data, buf, p->n*BLK);
+			p->src = p->data;
+		}
+
+		pthread_mutex_lock(&lock);
+		p->state = SLOT_READ;
+		seq_read++;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&lock);
+		if (n<BATCH*BLK) break;
+	}
+
+	pthread_mutex_lock(&lock);
+	seq_end = seq_read;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+
+	for (i=0; i<=threads; i++) pthread_join(th[i], 0);
+	free(th); free(slots);
+	return(0);
+}
+
+
 /************
  *   MAIN   *
  ***********/
 int main(int argc, char *argv[]) {
 
-	FILE *fi,*fo;
-	uint8_t data[ITEMS/8];
-	uint1024 d;
-	uint8_t r;
+	ks_file_t *fi,*fo;
+	const uint8_t *buf,*rest;
+	uint8_t plain[BATCH*ITEMS/8], *p;
+	uint8_t r,t;
+	off_t size;
+	int n,k,nrest;
 	
 	verbose = 1;
 	if (parse_args(argc,argv)) return(1);
 	
-	switch (load_priv_key(key_fn)) {
+	if (!(ctx=ks_ctx_new())) {
+		fprintf(stderr,"Not enough memory.\n");
+		return(2);
+	}
+	switch (ks_load_priv_key(ctx, key_fn)) {
 		case 0: break;
 		case -1:
 			fprintf(stderr,"Could not open %s.\n",key_fn);
@@ -125,46 +384,94 @@ int main(int argc, char *argv[]) {
 			fprintf(stderr,"Incorrect format of private key.\n");
 			return(3);
 	}
+	if (tables && ks_set_dec_tables(ctx, 1))
+		fprintf(stderr,"Not enough memory for tables, decrypting without them.\n");
+	if (ks_set_dec_comb(ctx, comb))
+		fprintf(stderr,"Not enough memory for tables, decrypting without them.\n");
 
-	if (in_fn && strcmp(in_fn,"-"))
-		if (!(fi=fopen(in_fn, "r"))) {
-			fprintf(stderr,"Could not open file %s.\n",in_fn);
-			return(4);
-		} else;
-	else fi=stdin;
+	if (!(fi=ks_open_in(in_fn))) {
+		fprintf(stderr,"Could not open file %s.\n",in_fn);
+		return(4);
+	}
 
-	if (out_fn && strcmp(out_fn,"-"))
-		if (!(fo=fopen(out_fn, "w"))) {
-			fprintf(stderr,"Could not create file %s.\n",out_fn);
-			return(5);
-		} else;
-	else fo=stdout;
-	
-	fread( &r, 1, 1, fi);
+	r=0;
+	if (ks_read(fi, &buf, 1)) r=buf[0];
+
+	/* size of output, if input is mapped */
+	size = -1;
+	if (fi->map) {
+		n = (fi->size-1)/BLK;
+		t = r;
+		if (r==KS_STREAM)
+			t = ((fi->size-1)%BLK==1) ? fi->map[fi->size-1] : 0;
+		if (t<=ITEMS/8) size = n ? (off_t) (n-1)*(ITEMS/8) + t : 0;
+	}
+
+	if (!(fo=ks_open_out(out_fn, size))) {
+		fprintf(stderr,"Could not create file %s.\n",out_fn);
+		return(5);
+	}
 	
-	read1024(fi, d);
-	while ( !feof(fi) && !ferror(fi) && !ferror(fo) ) {
-		decrypt(d,data);
-		if (read1024(fi, d)) break;
-		if (!feof(fi)) fwrite(data, 1, ITEMS/8, fo); 
+	/* the last block is written after r is known */
+	rest=0; nrest=0;
+	if (threads>1) {
+		if (decrypt_threaded(fi, fo, &rest, &nrest)) {
+			fputs("Could not start threads.\n",stderr);
+			return(9);
+		}
+	} else
+	while ( !fi->err && !fo->err ) {
+		n=ks_read(fi, &buf, BATCH*BLK);
+		k=n/BLK;
+		rest = buf+k*BLK; nrest = n-k*BLK;
+		if (k) {
+			decrypt_batch(buf, k, plain);
+			if (write_batch(fo, plain, k)) break;
+		}
+		if (n<BATCH*BLK) break;
 	}	
-				
+
+	if (write_err || fo->err) {
+		fprintf(stderr, "Could not write to %s\n", 
+			(out_fn)?out_fn:"stdout");
+		return(7);
+	}
+
+	/* rest is still in fi's buffer */
+	if (fi->err) {
+		fprintf(stderr, "Error encountered during reading from %s\n",
+				(in_fn)?in_fn:"stdin");
+		return(6);
+	}
+
+	if (r==KS_STREAM) {
+		if (nrest!=1 || rest[0]>ITEMS/8) {
+			fprintf(stderr, "Stream %s is truncated\n",
+				(in_fn)?in_fn:"stdin");
+			return(8);
+		}
+		r=rest[0];
+	} else if (nrest) {
+		/* part of a block follows the last whole one */
+		fprintf(stderr, "File %s is truncated\n",
+			(in_fn)?in_fn:"stdin");
+		return(8);
+	}
 	
-	if (ferror(fi)) {
+	if (ks_close(fi)) {
 		fprintf(stderr, "Error encountered during reading from %s\n",
 				in_fn);
 		return(6);
 	}
-	fclose(fi); 	
 
-	if (r) fwrite(data, 1, r, fo);
+	if (r>ITEMS/8) r=ITEMS/8;	/* damaged header */
+	if (have && r && (p=ks_wbuf(fo, r))) memcpy(p, last, r);
 	
-	if (ferror(fo)) {
+	if (ks_close(fo)) {
 		fprintf(stderr, "Could not write to %s\n", 
 			(out_fn)?out_fn:"stdout");
 		return(7);
 	}
-	fclose(fo);
 	
 	return(0);	
 } /* main */
@@ -186,6 +493,13 @@ Options:
 		--help			show this
 
 	-k	--key-file		specifies file containing private key
+	-T	--tables		1 = find plaintext bytes in precomputed
+					subset sums of private key (default),
+					0 = item by item
+	-t	--threads		number of decrypting threads (default 1)
+	-C	--comb			bits of ciphertext per precomputed table
+					of multiples of u (0-10, 0 = no tables;
+					by default 8 if m is even, otherwise 0)
 ",APP_NAME);
 }
 
@@ -23,13 +23,27 @@
 
 #include "ks_crypt.h"
 #include "uint1024.h"
+#include "ks_io.h"
 #include "config.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
+#include <pthread.h>
 
 char *in_fn, *out_fn, *key_fn="public-key";
 	/* files with key, input file & output file */
+ks_ctx *ctx;
+	/* the public key */
+int window=-1;
+	/* bits of plaintext per precomputed table, 0 = no tables,
+	   -1 = tables only if there is no AVX-512 kernel */
+
+#define BATCH 64
+	/* blocks read and encrypted at once */
+int threads=1;
+	/* number of encrypting threads */
 
 void init(char *pn);			/* prints stuff about prog&author */
 void warranty(void);			/* warranty - cut&pasted from GPL */
@@ -43,11 +57,13 @@ int parse_args(int argc, char *argv[]) {
 		{ "warranty", 0, 0, 'w'},
 		{ "help", 0, 0, 0},
 		{ "key-file", 1, 0, 'k'},
+		{ "window", 1, 0, 'W'},
+		{ "threads", 1, 0, 't'},
 		{ 0, 0, 0, 0}
 	};
 
 	while (1) {
-		c = getopt_long (argc, argv, "wk:", 
+		c = getopt_long (argc, argv, "wk:W:t:", 
 				 long_options, &opt_ix);
 
 		if (c==-1) break;
@@ -79,6 +95,22 @@ int parse_args(int argc, char *argv[]) {
 		    
 		  case 'k': key_fn=optarg; break;
 
+		  case 'W':
+		    if (sscanf(optarg,"%d", &window)!=1 || window<-1 || window>16) {
+			    fprintf(stderr,"Invalid argument for --window: %s\n",
+					    optarg);
+			    return(1);
+		    }
+		    break;
+
+		  case 't':
+		    if (sscanf(optarg,"%d", &threads)!=1 || threads<1) {
+			    fprintf(stderr,"Invalid argument for --threads: %s\n",
+					    optarg);
+			    return(1);
+		    }
+		    break;
+
 		  case '?':
 		    return(1);
 	  	  default:
@@ -103,21 +135,182 @@ int parse_args(int argc, char *argv[]) {
 }
 
 
+/*
+ * points data to up to BATCH blocks of input; a short last block is
+ * copied to pad (BATCH blocks long) and filled up by zeros
+ * returns number of blocks, r is set to bytes in the last one
+ */
+int read_batch(ks_file_t *fi, const uint8_t **data, uint8_t *pad,
+		uint8_t *r) {
+	int i,n;
+
+	n=ks_read(fi, data, BATCH*ITEMS/8);
+	if (!n) return(0);
+	*r = (n-1)%(ITEMS/8)+1;
+	if (n%(ITEMS/8)) {
+		memcpy(pad, *data, n);
+		for (i=n; i%(ITEMS/8); i++) pad[i]=0;
+		*data = pad;
+	}
+	return((n+ITEMS/8-1)/(ITEMS/8));
+}
+
+/*
+ * stores n encrypted blocks to fo
+ * returns non-zero if failed
+ */
+int write_batch(ks_file_t *fo, const uint1024 *d, int n) {
+	uint8_t *p;
+
+	if (!(p = ks_wbuf(fo, n*4*__SZ1024_32))) return(1);
+	while (n--) {
+		store1024(p, *d++);
+		p += 4*__SZ1024_32;
+	}
+	return(0);
+}
+
+
+/*
+ * --threads: main() reads batches into a ring of slots, workers
+ * encrypt them in any order and writer() stores them in the order
+ * they were read; the ring bounds memory to 4 batches per thread
+ */
+struct slot {
+	const uint8_t	*src;		/* batch in mapped input or data */
+	uint8_t		data[BATCH*ITEMS/8];
+	uint1024	d[BATCH];
+	int		n;		/* blocks in batch */
+	int		state;
+};
+
+enum { SLOT_FREE, SLOT_READ, SLOT_DONE };
+
+struct slot *slots;
+int nslots;
+int seq_read, seq_work, seq_end=-1;
+	/* batches read, taken by workers, total (-1 until EOF) */
+int write_err;
+	/* writer() failed, everyone stops */
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+void *worker(void *arg) {
+	struct slot *p;
+
+	pthread_mutex_lock(&lock);
+	while (1) {
+		while (seq_work>=seq_read && seq_end<0 && !write_err)
+			pthread_cond_wait(&cond, &lock);
+		if (seq_work>=seq_read || write_err) break;
+
+		p = &slots[seq_work++ % nslots];
+		pthread_mutex_unlock(&lock);
+		ks_encryptn(ctx, p->src, p->n, p->d);
+		pthread_mutex_lock(&lock);
+		p->state = SLOT_DONE;
+		pthread_cond_broadcast(&cond);
+	}
+	pthread_mutex_unlock(&lock);
+	return(0);
+}
+
+void *writer(void *fo) {
+	struct slot *p;
+	int s,e;
+
+	pthread_mutex_lock(&lock);
+	for (s=0; ; s++) {
+		p = &slots[s % nslots];
+		while (p->state!=SLOT_DONE && (seq_end<0 || s<seq_end))
+			pthread_cond_wait(&cond, &lock);
+		if (p->state!=SLOT_DONE) break;
+
+		pthread_mutex_unlock(&lock);
+		e = write_batch(fo, p->d, p->n);
+		pthread_mutex_lock(&lock);
+		p->state = SLOT_FREE;
+		pthread_cond_broadcast(&cond);
+		if (e) { write_err = 1; break; }
+	}
+	pthread_mutex_unlock(&lock);
+	return(0);
+}
+
+/*
+ * encrypts fi to fo using threads workers
+ * returns non-zero if threads can't be started; a write error stops
+ * it with write_err set
+ */
+int encrypt_threaded(ks_file_t *fi, ks_file_t *fo, uint8_t *r) {
+	pthread_t *th;
+	struct slot *p;
+	int i,e;
+
+	nslots = 4*threads;
+	slots = calloc(nslots, sizeof(struct slot));
+	th = calloc(threads+1, sizeof(pthread_t));
+	if (!slots || !th) return(1);
+
+	if (pthread_create(&th[0], 0, writer, fo)) return(1);
+	for (i=1; i<=threads; i++)
+		if (pthread_create(&th[i], 0, worker, 0)) return(1);
+
+	while (1) {
+		p = &slots[seq_read % nslots];
+		pthread_mutex_lock(&lock);
+		while (p->state!=SLOT_FREE && !write_err)
+			pthread_cond_wait(&cond, &lock);
+		e = write_err;
+		pthread_mutex_unlock(&lock);
+		if (e) break;
+
+		if (!(p->n = read_batch(fi, &p->src, p->data, r))) break;
+		/* buffered input is overwritten by the next read */
+		if (!fi->map && p->src!=p->data) {
+			memcpy(p->data, p->src, p->n*ITEMS/8);
+			p->src = p->data;
+		}
+
+		pthread_mutex_lock(&lock);
+		p->state = SLOT_READ;
+		seq_read++;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+
+	pthread_mutex_lock(&lock);
+	seq_end = seq_read;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+
+	for (i=0; i<=threads; i++) pthread_join(th[i], 0);
+	free(th); free(slots);
+	return(0);
+}
+
+
 /************
  *   MAIN   *
  ***********/
 int main(int argc, char *argv[]) {
 
-	FILE *fi,*fo, *ft;
-	uint8_t data[ITEMS/8];
-	uint1024 d;
-	int e;
-	uint8_t r;
+	ks_file_t *fi,*fo;
+	const uint8_t *data;
+	uint8_t pad[BATCH*ITEMS/8];
+	uint1024 d[BATCH];
+	off_t size;
+	int n,e;
+	uint8_t r,*p;
 	
 	verbose = 1;
 	if (parse_args(argc,argv)) return(1);
 	
-	switch (load_pub_key(key_fn)) {
+	if (!(ctx=ks_ctx_new())) {
+		fprintf(stderr,"Not enough memory.\n");
+		return(2);
+	}
+	switch (ks_load_pub_key(ctx, key_fn)) {
 		case 0: break;
 		case -1:
 			fprintf(stderr,"Could not open %s.\n",key_fn);
@@ -126,68 +319,56 @@ int main(int argc, char *argv[]) {
 			fprintf(stderr,"Incorrect format of public key.\n");
 			return(3);
 	}
+	if (window<0) window = (ks_encrypt_lanes()<8) ? 8 : 0;
+	if (ks_set_enc_window(ctx, window))
+		fprintf(stderr,"Not enough memory for tables, encrypting without them.\n");
 
-	if (in_fn && strcmp(in_fn,"-"))
-		if (!(fi=fopen(in_fn, "r"))) {
-			fprintf(stderr,"Could not open file %s.\n",in_fn);
-			return(4);
-		} else;
-	else fi=stdin;
-
-	if (out_fn && strcmp(out_fn,"-"))
-		if (!(fo=fopen(out_fn, "w"))) {
-			fprintf(stderr,"Could not create file %s.\n",out_fn);
-			return(5);
-		} else;
-	else fo=stdout;
-	
-	if (!(ft=tmpfile() )) {
-		fputs("Could not create temp file.\n",stderr);
-		return(6);
+	if (!(fi=ks_open_in(in_fn))) {
+		fprintf(stderr,"Could not open file %s.\n",in_fn);
+		return(4);
+	}
+
+	/* size of output, if input size is known */
+	size = -1;
+	if (fi->map) size = 1 + (fi->size+ITEMS/8-1)/(ITEMS/8)*4*__SZ1024_32;
+
+	if (!(fo=ks_open_out(out_fn, size))) {
+		fprintf(stderr,"Could not create file %s.\n",out_fn);
+		return(5);
 	}
 	
-	e=0;
-	while ( !feof(fi) && !ferror(fi) && !ferror(ft) ) {
-		r=fread(data, 1, ITEMS/8, fi);
-		if (r) {
-  			for (e=r; e<ITEMS/8; e++) data[e]=0;
-			encrypt(data,d);
-			write1024(ft, d);
-			e=1;
+	/* r is patched when the output is seekable */
+	r = (fo->map || fo->start>=0) ? 0 : KS_STREAM;
+	if ((p = ks_wbuf(fo, 1))) *p = r;
+
+	r=0;
+	if (threads>1) {
+		if (encrypt_threaded(fi, fo, &r)) {
+			fputs("Could not start threads.\n",stderr);
+			return(9);
 		}
+	} else
+	while ( !fi->err && !fo->err ) {
+		if (!(n = read_batch(fi, &data, pad, &r))) break;
+		ks_encryptn(ctx,data,n,d);
+		if (write_batch(fo, d, n)) break;
 	}	
 	
-	if (ferror(fi)) {
+	if (ks_close(fi)) {
 		fprintf(stderr, "Error encountered during reading from %s\n",
 				in_fn);
 		return(7);
 	}
-	fclose(fi); 	
 
-	if (ferror(ft)) {
-		fprintf(stderr, "Could not write to temp file\n"); 
-		return(8);
-	}
-	
-	if (e && !r) r=ITEMS/8;
-	fwrite( &r, 1, 1, fo);
-	rewind(ft);
-	while (!ferror(ft) && !ferror(fo)) {
-		read1024(ft,d);
-		if (!feof(ft)) write1024(fo,d); else break;
-	}
-	
-	if (ferror(ft)) {
-		fprintf(stderr, 
-			"Error encountered during reading from temp file\n");
-		return(7);
-	}
-	if (ferror(fo)) {
+	e=0;
+	if (fo->map || fo->start>=0) e = ks_patch(fo, 0, &r, 1);
+	else if ((p = ks_wbuf(fo, 1))) *p = r;
+
+	if (ks_close(fo) || e || write_err) {
 		fprintf(stderr, "Could not write to %s\n", 
 			(out_fn)?out_fn:"stdout");
 		return(8);
 	}
-	fclose(fo); fclose(ft);
 
 	return(0);	
 } /* main */
@@ -209,6 +390,10 @@ Options:
 		--help			show this
 
 	-k	--key-file		specifies file containing public key
+	-t	--threads		number of encrypting threads (default 1)
+	-W	--window		bits of plaintext per precomputed table
+					(0-16, 0 = no tables; by default 8,
+					or 0 if the CPU has AVX-512)
 ",APP_NAME);
 }
 
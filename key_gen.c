@@ -30,10 +30,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 char *pub_key_file = "public-key";	/* file name for public key */
 char *priv_key_file = "private-key";	/* file name for private key */
 unsigned int seed;			/* seed for priv_key generator */
+int threads=1;				/* threads or farm workers */
+int count;				/* keypairs of the farm, 0 = one
+					   pair to the files above */
+char *out_dir=".";			/* directory of the farm */
 
 void init(char *pn);			/* prints stuff about prog&author */
 void warranty(void);			/* warranty - cut&pasted from GPL */
@@ -51,11 +58,14 @@ int parse_args(int argc, char *argv[]) {
 		{ "help", 0, 0, 0},
 		{ "seed", 1, 0, 's'},
 		{ "quite", 0, 0, 'q'},
+		{ "threads", 1, 0, 't'},
+		{ "count", 1, 0, 'c'},
+		{ "out-dir", 1, 0, 'd'},
 		{ 0, 0, 0, 0}
 	};
 
 	while (1) {
-		c = getopt_long (argc, argv, "qwv::s:", long_options, &opt_ix);
+		c = getopt_long (argc, argv, "qwv::s:t:c:d:", long_options, &opt_ix);
 
 		if (c==-1) break;
 
@@ -93,6 +103,21 @@ int parse_args(int argc, char *argv[]) {
 			    return(1);
 		    } 
 		    break;
+		  case 't':
+		    if (sscanf(optarg,"%d", &threads)!=1 || threads<1) {
+			    fprintf(stderr, "Invalid argument for --threads: %s\n",
+					    optarg);
+			    return(1);
+		    }
+		    break;
+		  case 'c':
+		    if (sscanf(optarg,"%d", &count)!=1 || count<1) {
+			    fprintf(stderr, "Invalid argument for --count: %s\n",
+					    optarg);
+			    return(1);
+		    }
+		    break;
+		  case 'd': out_dir=optarg; break;
 		  case '?':
 		    return(1);
 	  	  default:
@@ -113,8 +138,96 @@ int parse_args(int argc, char *argv[]) {
   return(0);
 }
 
+/*
+ * writes n bytes of p to a new file fn by one write()
+ * returns non-zero if failed
+ */
+int write_file(const char *fn, const uint8_t *p, size_t n) {
+	ssize_t r;
+	int fd;
+
+	if ((fd = open(fn, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0) return(1);
+	while (n && (r = write(fd, p, n)) > 0) { p += r; n -= r; }
+	return(close(fd) || n);
+}
+
+/*
+ * --count: keypair i is the one of seed+i, it goes to
+ * out_dir/private-key-i and out_dir/public-key-i; worker w of n makes
+ * pairs w, w+n, ... with a context of its own
+ * returns non-zero if some pair couldn't be written
+ */
+int farm_part(int w, int n) {
+	uint8_t *priv, *pub;
+	char fn[4096];
+	ks_ctx *ctx;
+	int i,e=0;
+
+	ctx = ks_ctx_new();
+	priv = malloc(KS_PRIV_KEY_SIZE); pub = malloc(KS_PUB_KEY_SIZE);
+	if (!ctx || !priv || !pub) {
+		ks_ctx_free(ctx); free(priv); free(pub);
+		fputs("Not enough memory\n", stderr);
+		return(1);
+	}
+	for (i=w; i<count; i+=n) {
+		ks_gen_priv_key(ctx, seed+i);
+		ks_gen_pub_key(ctx);
+		ks_priv_key_bytes(ctx, priv);
+		ks_pub_key_bytes(ctx, pub);
+
+		snprintf(fn, sizeof(fn), "%s/private-key-%d", out_dir, i);
+		if (write_file(fn, priv, KS_PRIV_KEY_SIZE)) {
+			fprintf(stderr, "Could not write %s\n", fn); e=1;
+		}
+		snprintf(fn, sizeof(fn), "%s/public-key-%d", out_dir, i);
+		if (write_file(fn, pub, KS_PUB_KEY_SIZE)) {
+			fprintf(stderr, "Could not write %s\n", fn); e=1;
+		}
+		if (verbose>1) printf("  Keypair %d (seed %u)\n", i, seed+i);
+	}
+	ks_ctx_free(ctx); free(priv); free(pub);
+	return(e);
+}
+
+int nworkers, next_worker, farm_err;
+pthread_mutex_t farm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *farm_worker(void *arg) {
+	int w,e;
+
+	pthread_mutex_lock(&farm_lock);
+	w = next_worker++;
+	pthread_mutex_unlock(&farm_lock);
+	e = farm_part(w, nworkers);
+	pthread_mutex_lock(&farm_lock);
+	farm_err |= e;
+	pthread_mutex_unlock(&farm_lock);
+	return(0);
+}
+
+/*
+ * runs farm_part() in up to 64 threads
+ * returns non-zero if some pair couldn't be written
+ */
+int farm(void) {
+	pthread_t th[64];
+	int i,w;
+
+	nworkers = threads<64 ? threads : 64;
+	if (nworkers>count) nworkers=count;
+	for (w=1; w<nworkers; w++)
+		if (pthread_create(&th[w], 0, farm_worker, 0)) break;
+	/* parts of workers that couldn't start are done here */
+	for (i=w; i<nworkers; i++) farm_worker(0);
+	farm_worker(0);
+	while (--w>0) pthread_join(th[w], 0);
+	return(farm_err);
+}
+
 int main(int argc, char *argv[]) {
   unsigned long tm;
+  ks_ctx *ctx;
   
   
   time(&tm);
@@ -123,12 +236,24 @@ int main(int argc, char *argv[]) {
   
   if (parse_args(argc, argv)) return(-1);
   
+  if (count) {
+    if (verbose>0) printf("Generating %d keypairs to %s ...\n", count, out_dir);
+    if (farm()) return(1);
+    if (verbose>0) puts("Done.");
+    return(0);
+  }
+  if (!(ctx = ks_ctx_new())) {
+    fputs("Not enough memory\n", stderr);
+    return(1);
+  }
+  ks_set_threads(ctx, threads);
+  
   if (verbose>0) puts("Generating private key ...");
   if (verbose>1) printf("  Seed: %u\n",seed);
-  gen_priv_key(seed);  
+  ks_gen_priv_key(ctx, seed);  
   
   if (verbose>0) printf("Writing >> %s\n",priv_key_file);
-  switch (store_priv_key(priv_key_file)) {
+  switch (ks_store_priv_key(ctx, priv_key_file)) {
 	case 0: break;
 	case -1: fputs("Could not open file private-key",stderr);
 		 break;
@@ -137,10 +262,10 @@ int main(int argc, char *argv[]) {
 
 
   if (verbose>0) puts("Generating public key ...");
-  gen_pub_key();
+  ks_gen_pub_key(ctx);
     
   if (verbose>0) printf("Writing >> %s\n",pub_key_file);
-  switch (store_pub_key(pub_key_file)) {
+  switch (ks_store_pub_key(ctx, pub_key_file)) {
 	  case 0: break;
 	  case -1: fputs("Could not open file public-key",stderr);
 		   break;
@@ -165,6 +290,13 @@ Options:
 		--help			show this
 
 	-s	--seed			set seed for random number generator
+	-t	--threads		number of threads computing the
+					public key (default 1, keys don't
+					change), with --count number of workers
+	-c	--count			generate this many keypairs: pair i
+					is the one of seed+i, it is written to
+					private-key-i and public-key-i
+	-d	--out-dir		directory for --count (default .)
 
 	--priv-key-file <file>		
 	--priv-key-file=<file>		specify filename for private key
@@ -25,138 +25,294 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+
+/*
+ * x86 intrinsics, ENC_SIMD and DEC_SIMD switch them off for encryption
+ * or decryption alone (e.g. -DENC_SIMD=0)
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KS_SIMD 1
+#include <immintrin.h>
+#else
+#define KS_SIMD 0
+#endif
+#ifndef ENC_SIMD
+#define ENC_SIMD KS_SIMD
+#endif
+#ifndef DEC_SIMD
+#define DEC_SIMD KS_SIMD
+#endif
+
+typedef		uint1024	kskey_t[ITEMS];
+
+/* ks_crypt.h spells out the sizes, a change of uint1024 must not pass */
+_Static_assert(sizeof(ks_block_t) == sizeof(uint1024),
+	"ks_block_t of ks_crypt.h differs from uint1024");
+_Static_assert(KS_CIPHER_BLOCK == 4*__SZ1024_32,
+	"KS_CIPHER_BLOCK of ks_crypt.h differs from __SZ1024_32 words");
+
+#define MONT_MAXK 40
+/*
+ * Montgomery constants for multi-block kernels, numbers are split into
+ * K digits of r bits, R = 2^(r*K) covers every ciphertext of a valid
+ * key (below 2^(bits(m)+8))
+ */
+struct mont_radix {
+	int8_t		r, K;
+	uint64_t	n[MONT_MAXK];	/* m */
+	uint64_t	b[MONT_MAXK];	/* u*R mod m */
+	uint64_t	n0;		/* -m^-1 mod 2^r */
+};
+
+/*
+ * keys of one context and everything precomputed from them; only
+ * gen_*, load_* and set_* write it, encrypt and decrypt just read it
+ */
+struct ks_ctx {
+	kskey_t		private_key, public_key;
+	uint1024	u,v,m;
+	uint1024	priv_sum;	/* sum of all items in private key */
+	int		threads;	/* of gen_pub_key() */
+
+	mont1024_t	m_mont;		/* Montgomery context of m */
+	uint1024	u_mont;		/* u in Montgomery form */
+	int8_t		m_odd;		/* m_mont and u_mont are valid */
+
+	uint64_t	priv_limbs[ITEMS*__SZ1024];
+					/* significant limbs of private key
+					   items, packed one after another */
+	const uint64_t	*priv_p[ITEMS];	/* item i in priv_limbs */
+	int8_t		priv_n[ITEMS];	/* its number of limbs */
+
+	uint64_t	*dec_table;	/* subset sums of private key bytes */
+	int		dec_off[ITEMS/8];	/* table of byte o in dec_table */
+	int8_t		dec_len[ITEMS/8];	/* limbs of its entries */
+
+	uint64_t	*comb_table;	/* d*u*2^(w*j) mod m, then h*2^b mod m */
+	uint64_t	*comb_red;	/* the second part of comb_table */
+	int8_t		comb_w;		/* bits of ciphertext per window */
+	int8_t		comb_len;	/* limbs of m */
+	int16_t		comb_b;		/* bits of m */
+
+	struct mont_radix mont52, mont28;
+
+	uint1024	*enc_table;	/* subset sums of public key items */
+	int8_t		enc_window;	/* bits of plaintext per table */
+
+	uint64_t	pub_32[ITEMS][__SZ1024_32];
+					/* public key in 32-bit words, one per
+					   64-bit lane */
+	int8_t		pub_words;	/* words used by the longest item */
+};
+
+ks_ctx	*ks_ctx_new	( void ) {
+	ks_ctx *ctx;
+
+	if (!(ctx = calloc(1, sizeof(ks_ctx)))) return(0);
+	ctx->threads = 1;
+	return(ctx);
+}
+
+void	ks_ctx_free	( ks_ctx *ctx ) {
+	if (!ctx) return;
+	free(ctx->enc_table);
+	free(ctx->dec_table);
+	free(ctx->comb_table);
+	free(ctx);
+}
 
 /******************************************************************
  *         PRIVATE KEY
  *****************************************************************/
 
-uint1024 priv_sum;	/* sum of all items in private key */
+static void build_dec_table ( ks_ctx *ctx );
+
+#define COMB_WINDOWS(w)	((64*__SZ1024+(w)-1)/(w))
+
+static void build_comb_table ( ks_ctx *ctx );
+
+static void prep_radix ( ks_ctx *ctx, struct mont_radix *P, int r );
 
 /*
- * finds random number m, m>priv_sum 
+ * number of significant limbs of A
  */
+static int limbs ( const uint64_t *A, int n ) {
+	while (n && !A[n-1]) n--;
+	return(n);
+}
 
-void find_m(void) {
-	uint1024 q;
-	int i;
-	unsigned long s;
-	
-	uint_to_1024(m,0);
-	
-	s=RAND_MAX; i=0;
-	while (s) { s>>=1; i++; }
-	s=i;
+/*
+ * prepares Montgomery context for decryption with {u, m} and packs
+ * private key for the greedy phase
+ */
+static void prep_priv_key ( ks_ctx *ctx ) {
+	uint64_t *p = ctx->priv_limbs;
+	int i,k;
 
-	for (i=0; (i<=1024) && (cmp1024(m,priv_sum)<=0); i+=s) {
-		uint_to_1024(q,random());
-		if (i) shl1024(m,s);
-		add1024(m,q);
+	ctx->m_odd = !mont_init1024(&ctx->m_mont, ctx->m);
+	if (ctx->m_odd) {
+		cpy1024(ctx->u_mont, ctx->u);
+		to_mont1024(&ctx->m_mont, ctx->u_mont);
+		prep_radix(ctx, &ctx->mont52, 52);
+		prep_radix(ctx, &ctx->mont28, 28);
 	}
 
-	while (cmp1024(m,priv_sum)<0) {
-		uint_to_1024(q, 1.0*(1<<(1022+s-i))*random()/RAND_MAX);
-		add1024(m,q);
+	for (i=0; i<ITEMS; i++) {
+		ctx->priv_n[i] = limbs(ctx->private_key[i], __SZ1024);
+		ctx->priv_p[i] = p;
+		for (k=0; k<ctx->priv_n[i]; k++) *p++ = ctx->private_key[i][k];
 	}
+	if (ctx->dec_table) build_dec_table(ctx);
+	if (ctx->comb_w) build_comb_table(ctx);
 }
 
 /*
- * finds number v, v<m which is relatively prime to m 
- * (sharing no factors with m besides 1)
+ * random numbers for keys: ChaCha20 keystream, the key is the seed,
+ * so a seed gives the same keys everywhere
  */
-void find_v(void) {
-	uint1024 one,g; uint_to_1024(one,1);
-	
-	cpy1024(v,m);
-	shr1024(v,1);
-	do {
-	  add1024(v,one);
-	  GCD(v,m,g); 
-	} while (cmp1024(g,one));
+typedef struct {
+	uint32_t	s[16];		/* state, s[12] counts blocks */
+	uint32_t	out[16];	/* current block of keystream */
+	int		pos;		/* words of out used */
+} ks_rng_t;
+
+#define ROTL32(x,n)	(((x)<<(n)) | ((x)>>(32-(n))))
+#define QR(a,b,c,d)	{ a+=b; d^=a; d=ROTL32(d,16); c+=d; b^=c; b=ROTL32(b,12); \
+			  a+=b; d^=a; d=ROTL32(d,8);  c+=d; b^=c; b=ROTL32(b,7); }
+
+static void rng_init ( ks_rng_t *R, unsigned int seed ) {
+	static const uint32_t sigma[4] =
+		{ 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+	int i;
+
+	for (i=0; i<16; i++) R->s[i]=0;
+	for (i=0; i<4; i++) R->s[i]=sigma[i];
+	R->s[4] = seed;
+	R->pos = 16;
+}
+
+static uint32_t rng_32 ( ks_rng_t *R ) {
+	uint32_t *x = R->out;
+	int i;
+
+	if (R->pos==16) {
+		for (i=0; i<16; i++) x[i] = R->s[i];
+		for (i=0; i<10; i++) {
+			QR(x[0],x[4],x[8],x[12]); QR(x[1],x[5],x[9],x[13]);
+			QR(x[2],x[6],x[10],x[14]); QR(x[3],x[7],x[11],x[15]);
+			QR(x[0],x[5],x[10],x[15]); QR(x[1],x[6],x[11],x[12]);
+			QR(x[2],x[7],x[8],x[13]); QR(x[3],x[4],x[9],x[14]);
+		}
+		for (i=0; i<16; i++) x[i] += R->s[i];
+		if (!++R->s[12]) R->s[13]++;
+		R->pos = 0;
+	}
+	return(x[R->pos++]);
 }
 
 /*
- * finds such u, so u*v=1 (mod m)
+ * A = random number of exactly n bits (the top one is set), 0<n<=1024,
+ * filled limb by limb from the keystream
  */
-void find_u(void) {
-	uint1024 A[3][2];
-	uint1024 N;
+static void rng_bits ( ks_rng_t *R, uint1024 A, int n ) {
+	int i;
 
+	uint_to_1024(A,0);
+	if (n>1024) n=1024;
+	for (i=0; i<(n+63)/64; i++) {
+		A[i] = (uint64_t) rng_32(R) << 32;
+		A[i] |= rng_32(R);
+	}
+	if (n%64) A[n/64] &= (1ULL<<n%64)-1;
+	A[(n-1)/64] |= 1ULL<<(n-1)%64;
+}
 
-	uint_to_1024(A[0][0],0);
-	uint_to_1024(A[1][0],1);
-	cpy1024(A[0][1], m);
-	cpy1024(A[1][1], v);
+/*
+ * finds random number m, m>priv_sum 
+ * it is 1..32 bits longer than priv_sum
+ */
+static void find_m ( ks_ctx *ctx, ks_rng_t *R ) {
+	int n;
 
-	while (non_zero1024(A[1][1])) {
-		cpy1024(A[2][0], A[1][0]);
-		cpy1024(A[2][1], A[1][1]);
-		
-		cpy1024(A[1][0], A[0][0]);
-		cpy1024(A[1][1], A[0][1]);
-		cpy1024(A[0][1], A[2][1]);
-		cpy1024(A[0][0], A[2][0]);
+	n = bits1024(ctx->priv_sum) + 1 + (rng_32(R) & 31);
+	if (n>1023) n=1023;
+	rng_bits(R, ctx->m, n);
+
+	/*
+	 * odd m lets decrypt() and gen_pub_key() use Montgomery
+	 * multiplication, and find_v() take (m+1)/2
+	 */
+	ctx->m[0] |= 1;
+}
 
+int	ks_set_threads	( ks_ctx *ctx, int n ) {
+	if (n<1) return(1);
+	ctx->threads = n;
+	return(0);
+}
 
 /*
- * X <- X%mm
- * Y <- [mm/X]*nn
+ * finds number v, v<m which is relatively prime to m 
+ * (sharing no factors with m besides 1)
+ * v = (m+1)/2 is: m is odd (find_m()), and a common factor of v and m
+ * would divide 2v-m = 1
  */
-#define mod(X,mm,Y,nn) \
-	cpy1024(N,mm); \
-	while (cmp1024(mm,X)<0) { shl1024(mm,1); shl1024(nn,1); }\
-\
-	while (cmp1024(X,N)>=0) {\
-		while (cmp1024(mm,X)>0) { shr1024(mm,1); shr1024(nn,1); }\
-		sub1024(X,mm);\
-		if (cmp1024(Y,nn)<0) add1024(Y,m); sub1024(Y,nn);\
-	}
-		
-		mod(A[1][1], A[2][1], A[1][0], A[2][0]);
-//		puts("dumping v:");
-//		dump1024(A[1][0]); dump1024(A[1][1]);
-	}	
+static void find_v ( ks_ctx *ctx ) {
+	uint1024 one;
 
-	cpy1024(u, A[0][0]);
+	uint_to_1024(one,1);
+	cpy1024(ctx->v,ctx->m);
+	add1024(ctx->v,one);
+	shr1024(ctx->v,1);
+}
+
+/*
+ * finds such u, so u*v=1 (mod m)
+ */
+static void find_u ( ks_ctx *ctx ) {
+	cpy1024(ctx->u, ctx->v);
+	if (inv1024modN(ctx->u, ctx->m)) uint_to_1024(ctx->u, 0);
 }
 
 
 
 
 /*
- * gen_priv_key()
+ * ks_gen_priv_key()
  */
-void gen_priv_key(const unsigned int seed) {
+void ks_gen_priv_key ( ks_ctx *ctx, const unsigned int seed ) {
   uint1024 a,one;
+  ks_rng_t R;
   int i;
 
   if (verbose>1)  puts("  Generating items");
-  srandom(seed);
+  rng_init(&R, seed);
 
-  uint_to_1024(priv_sum,0);
+  uint_to_1024(ctx->priv_sum,0);
   
+  /*
+   * item i is 1..3 bits longer than the sum of items before it, so it
+   * is bigger than the sum; its limbs come straight from the stream
+   */
   for (i=0; i<ITEMS; i++) {
-    uint_to_1024(private_key[i],0);
-    while (cmp1024(private_key[i],priv_sum)<=0) {
-      shl1024(private_key[i],4);
-      uint_to_1024(a,(uint) (16.0*random()/RAND_MAX));
-      add1024(private_key[i],a);
-    }
-    add1024(priv_sum,private_key[i]);
-
+    rng_bits(&R, ctx->private_key[i], bits1024(ctx->priv_sum) + 1 + rng_32(&R) % 3);
+    add1024(ctx->priv_sum,ctx->private_key[i]);
   }
   
   if (verbose>1) puts("  Counting 'm'"); 
-  find_m();
+  find_m(ctx, &R);
   
   if (verbose>1) puts("  Counting 'v'");
-  find_v();
+  find_v(ctx);
   
   if (verbose>1) puts("  Counting 'u'");
-  find_u();
+  find_u(ctx);
+  prep_priv_key(ctx);
 
   if (verbose>1) puts("  Checking u*v=1 (mod m)");
-  cpy1024(a, u);
-  mul1024modN(a,v,m);
+  cpy1024(a, ctx->u);
+  mul1024modN(a,ctx->v,ctx->m);
   uint_to_1024(one,1);
   if (cmp1024(one,a)) {
 	  puts("!! WARNING !! u*v != 1 (mod m) !! WARNING !!");
@@ -170,59 +326,135 @@ void gen_priv_key(const unsigned int seed) {
 /*
  * writes/reads {private_key, u, m} to/from specified file
  */
-int		store_priv_key	( const char *file_name ){
+int		ks_store_priv_key	( const ks_ctx *ctx, const char *file_name ){
 	FILE *f; int r=0;
 	f = fopen(file_name, "w");
 	if (f) {
-		if (fwrite(private_key,sizeof(uint1024),ITEMS, f)!=ITEMS)
+		if (write1024n(f, ctx->private_key, ITEMS))
 			r=1;
 		else
-		if (fwrite(m, sizeof(uint1024), 1, f)!=1)
+		if (write1024(f, ctx->m))
 			r=1;
 		else
-		if (fwrite(u, sizeof(uint1024), 1, f)!=1)
+		if (write1024(f, ctx->u))
 			r=1;
 	} else return(-1);
-	fclose(f);
+	if (fclose(f)) r=1;
 	return(r);
 }
 
-int		load_priv_key	( const char *file_name ){
+void	ks_priv_key_bytes	( const ks_ctx *ctx, uint8_t *buf ) {
+	int i;
+
+	for (i=0; i<ITEMS; i++, buf+=4*__SZ1024_32)
+		store1024(buf, ctx->private_key[i]);
+	store1024(buf, ctx->m);
+	store1024(buf+4*__SZ1024_32, ctx->u);
+}
+
+int		ks_load_priv_key	( ks_ctx *ctx, const char *file_name ){
 	FILE *f; int r=0;
 	f = fopen(file_name, "r");
 	if (f) {
-		if (fread(private_key,sizeof(uint1024),ITEMS, f)!=ITEMS)
+		if (read1024n(f, ctx->private_key, ITEMS))
 			r=1;
 		else
-		if (fread(m, sizeof(uint1024), 1, f)!=1)
+		if (read1024(f, ctx->m))
 			r=2;
 		else
-		if (fread(u, sizeof(uint1024), 1, f)!=1)
+		if (read1024(f, ctx->u))
 			r=3;
 	} else return(-1);
 	fclose(f);
+	if (!r) prep_priv_key(ctx);
 	return(r);
 }
 
 
 
-
 /******************************************************************
  *                 PUBLIC KEY
  ******************************************************************/
 
-void gen_pub_key(void) {
-	uint16_t i;
+static void build_enc_table ( ks_ctx *ctx );
+
+/*
+ * prepares encrypt() for current public_key
+ */
+static void prep_pub_key ( ks_ctx *ctx ) {
+	int i,k;
+
+	ctx->pub_words = 0;
+	for (i=0; i<ITEMS; i++)
+		for (k=0; k<__SZ1024_32; k++) {
+			ctx->pub_32[i][k] = (uint32_t) (ctx->public_key[i][k/2] >> 32*(k%2));
+			if (ctx->pub_32[i][k] && k>=ctx->pub_words) ctx->pub_words = k+1;
+		}
+	if (ctx->enc_window) build_enc_table(ctx);
+}
+
+/*
+ * state shared by threads of ks_gen_pub_key(), thread t transforms
+ * items t, t+threads, ...
+ */
+struct pub_items {
+	ks_ctx		*ctx;
+	mont1024_t	M;
+	uint1024	vm;	/* v*R mod m */
+	int8_t		odd;	/* M and vm are valid */
+	int		threads;
+	int		next;	/* thread number of the next pub_items() */
+	pthread_mutex_t	lock;
+};
+
+static void *pub_items ( void *arg ) {
+	struct pub_items *S = arg;
+	ks_ctx *ctx = S->ctx;
+	int i;
+
+	pthread_mutex_lock(&S->lock);
+	i = S->next++;
+	pthread_mutex_unlock(&S->lock);
+	for (; i<ITEMS; i+=S->threads) {
+		cpy1024(ctx->public_key[i], ctx->private_key[i]);
+		if (S->odd)
+			/* private_key[i] * (v*R) / R = private_key[i] * v */
+			mont_mul1024(&S->M, ctx->public_key[i], S->vm);
+		else
+			mul1024modN(ctx->public_key[i], ctx->v, ctx->m);
+	}
+	return(0);
+}
+
+void ks_gen_pub_key ( ks_ctx *ctx ) {
+	struct pub_items S;
+	pthread_t th[64];
+	int i,k;
 #if SHAKE_PUB_KEY
 	uint1024 c;
 	uint1024 t;
 #define swap(A,B) { cpy1024(t,A); cpy1024(A,B); cpy1024(B,t); }
 #endif
 	if (verbose>1) puts("  Changing values [ *v mod m ]");
-	for (i=0; i<ITEMS; i++) {
-		cpy1024(public_key[i], private_key[i]);
-		mul1024modN(public_key[i], v, m);
+	S.ctx = ctx;
+	S.odd = !mont_init1024(&S.M, ctx->m);
+	if (S.odd) {
+		cpy1024(S.vm, ctx->v);
+		to_mont1024(&S.M, S.vm);
 	}
+
+	S.threads = ctx->threads<64 ? ctx->threads : 64;
+	S.next = 0;
+	pthread_mutex_init(&S.lock, 0);
+	for (k=1; k<S.threads; k++)
+		if (pthread_create(&th[k], 0, pub_items, &S))
+			break;
+	/* items of threads that couldn't start are done here */
+	for (i=k; i<S.threads; i++) pub_items(&S);
+	pub_items(&S);
+	while (--k>0) pthread_join(th[k], 0);
+	pthread_mutex_destroy(&S.lock);
+	prep_pub_key(ctx);
 #if SHAKE_PUB_KEY
 /*
  * well, the values should be yet distributed 'randomly'. If we will shake them,
@@ -241,25 +473,33 @@ void gen_pub_key(void) {
 /*
  * writes/reads public_key to/from specified file
  */
-int		store_pub_key	( const char *file_name ){
+int		ks_store_pub_key	( const ks_ctx *ctx, const char *file_name ){
   	FILE *f; int r=0;
 	f = fopen(file_name, "w");
 	if (f) {
-		if (fwrite(public_key, sizeof(uint1024), ITEMS, f)!=ITEMS)
+		if (write1024n(f, ctx->public_key, ITEMS))
 			r=1;
 	} else return(-1);
-	fclose(f);
-	return(0);
+	if (fclose(f)) r=1;
+	return(r);
 }
 
-int		load_pub_key	( const char *file_name ){
+void	ks_pub_key_bytes	( const ks_ctx *ctx, uint8_t *buf ) {
+	int i;
+
+	for (i=0; i<ITEMS; i++, buf+=4*__SZ1024_32)
+		store1024(buf, ctx->public_key[i]);
+}
+
+int		ks_load_pub_key	( ks_ctx *ctx, const char *file_name ){
   	FILE *f; int r=0;
 	f = fopen(file_name, "r");
 	if (f) {
-		if (fread(public_key, sizeof(uint1024), ITEMS, f) != ITEMS)
+		if (read1024n(f, ctx->public_key, ITEMS))
 			r=-1;
 		fclose(f);
 	} else return(1);
+	if (!r) prep_pub_key(ctx);
 	return(r);
 }
 
@@ -269,19 +509,225 @@ int		load_pub_key	( const char *file_name ){
  * 			Encryption
  ************************************************************/
 
+/*
+ * table j holds all 2^w subset sums of items j*w .. j*w+w-1, entry x
+ * is the sum of items whose bits are set in x; each is built from an
+ * entry with one bit less
+ */
+static void build_enc_table ( ks_ctx *ctx ) {
+	int j,k,w,b;
+	uint1024 *T;
+
+	w = ctx->enc_window;
+	for (j=0; j*w<ITEMS; j++) {
+		T = ctx->enc_table + (j<<w);
+		uint_to_1024(T[0],0);
+		for (k=1; k<1<<w; k++) {
+			b = __builtin_ctz(k);
+			cpy1024(T[k], T[k & (k-1)]);
+			if (j*w+b<ITEMS) add1024(T[k], ctx->public_key[j*w+b]);
+		}
+	}
+}
+
+int	ks_set_enc_window	( ks_ctx *ctx, int w ) {
+	uint1024 *T=0;
+
+	if (w<0 || w>16) return(1);
+	if (w && !(T=malloc((sizeof(uint1024)*((ITEMS+w-1)/w))<<w)))
+		return(1);
+
+	free(ctx->enc_table);
+	ctx->enc_table = T; ctx->enc_window = w;
+	if (w) build_enc_table(ctx);
+	return(0);
+}
+
+/*
+ * w bits of data starting at bit i
+ */
+static unsigned int get_bits ( const uint8_t *d, int i, int w ) {
+	unsigned int x=0;
+	int k;
+
+	for (k=0; k<3 && (i>>3)+k<ITEMS/8; k++)
+		x |= d[(i>>3)+k] << 8*k;
+	return((x >> (i&7)) & ((1<<w)-1));
+}
+
+/*
+ * 64 bits of data from byte o/8 on, bit i of the result is bit o+i
+ */
+static uint64_t get_64 ( const uint8_t *d, int o ) {
+	uint64_t x=0;
+	int k;
+
+	for (k=0; k<8; k++) x |= (uint64_t) d[o/8+k] << 8*k;
+	return(x);
+}
+
+/*
+ * dest = sum of n 32-bit words acc[0], acc[s], acc[2*s] ...
+ */
+static void enc_carry ( const uint64_t *acc, int s, int n, uint1024 dest ) {
+	uint64_t c=0;
+	int k;
+
+	for (k=0; k<__SZ1024_32; k++) {
+		if (k<n) c += acc[k*s];
+		if (k%2) dest[k/2] |= c << 32;
+		else dest[k/2] = (uint32_t) c;
+		c >>= 32;
+	}
+}
+
 /*
  * returns encrypted first ITEMS bites of data
+ *
+ * without tables, items of set bits are summed in 32-bit words held
+ * by 64-bit lanes: ITEMS additions of 32-bit words can't overflow a
+ * lane, so carries are propagated only once at the end
  */
-void encrypt	( const void *data, uint1024 dest ) {
-	uint8_t  t=0;
-	int16_t i,o;
+void ks_encrypt	( const ks_ctx *ctx, const void *data, uint1024 dest ) {
+	const uint8_t *d = data;
+	uint64_t acc[__SZ1024_32], bits;
+	const uint64_t *p;
+	int16_t i,o,k,n;
 
-	o=-1; uint_to_1024(dest,0);
+	if (ctx->enc_window) {
+		/* one addition per window */
+		o = ctx->enc_window;
+		cpy1024(dest, ctx->enc_table[get_bits(data,0,o)]);
+		for (i=1; i*o<ITEMS; i++)
+			add1024(dest, ctx->enc_table[(i<<o) | get_bits(data,i*o,o)]);
+		return;
+	}
 
-	for (i=0; i<ITEMS; i++) {
-		if (!(i%8)) t=((uint8_t *)data)[++o];
-		if (t&1) add1024(dest, public_key[i]); 
-		t>>=1;
+	n = ctx->pub_words;
+	for (k=0; k<n; k++) acc[k]=0;
+
+	for (o=0; o<ITEMS; o+=64) {
+		bits = get_64(d,o);
+
+		while (bits) {
+			i = o + __builtin_ctzll(bits);
+			bits &= bits-1;
+			p = ctx->pub_32[i];
+			for (k=0; k<n; k++) acc[k] += p[k];
+		}
+	}
+
+	enc_carry(acc, 1, n, dest);
+}
+
+#if ENC_SIMD
+/*
+ * multi-block kernels: lane j of the accumulators belongs to block j,
+ * item i is added to the lanes whose block has bit i set
+ */
+__attribute__((target("avx2")))
+static void encrypt4_avx2 ( const ks_ctx *ctx, const uint8_t *d,
+		uint1024 *dest ) {
+	__m256i acc[__SZ1024_32], V, msk;
+	const __m256i one = _mm256_set1_epi64x(1);
+	uint64_t t[__SZ1024_32][4];
+	const uint64_t *p;
+	int i,j,k,o,n;
+
+	n = ctx->pub_words;
+	for (k=0; k<n; k++) acc[k] = _mm256_setzero_si256();
+
+	for (o=0; o<ITEMS; o+=64) {
+		V = _mm256_set_epi64x(get_64(d+3*ITEMS/8,o), get_64(d+2*ITEMS/8,o),
+				get_64(d+ITEMS/8,o), get_64(d,o));
+		for (i=0; i<64; i++) {
+			msk = _mm256_sub_epi64(_mm256_setzero_si256(),
+					_mm256_and_si256(V,one));
+			V = _mm256_srli_epi64(V,1);
+			if (_mm256_testz_si256(msk,msk)) continue;
+			p = ctx->pub_32[o+i];
+			for (k=0; k<n; k++)
+				acc[k] = _mm256_add_epi64(acc[k], _mm256_and_si256(
+					_mm256_set1_epi64x(p[k]), msk));
+		}
+	}
+
+	for (k=0; k<n; k++) _mm256_storeu_si256((__m256i *) t[k], acc[k]);
+	for (j=0; j<4; j++) enc_carry(&t[0][j], 4, n, dest[j]);
+}
+
+__attribute__((target("avx512f")))
+static void encrypt8_avx512 ( const ks_ctx *ctx, const uint8_t *d,
+		uint1024 *dest ) {
+	__m512i acc[__SZ1024_32], V;
+	const __m512i one = _mm512_set1_epi64(1);
+	uint64_t t[__SZ1024_32][8];
+	const uint64_t *p;
+	__mmask8 m;
+	int i,j,k,o,n;
+
+	n = ctx->pub_words;
+	for (k=0; k<n; k++) acc[k] = _mm512_setzero_si512();
+
+	for (o=0; o<ITEMS; o+=64) {
+		V = _mm512_set_epi64(get_64(d+7*ITEMS/8,o), get_64(d+6*ITEMS/8,o),
+				get_64(d+5*ITEMS/8,o), get_64(d+4*ITEMS/8,o),
+				get_64(d+3*ITEMS/8,o), get_64(d+2*ITEMS/8,o),
+				get_64(d+ITEMS/8,o), get_64(d,o));
+		for (i=0; i<64; i++) {
+			m = _mm512_test_epi64_mask(V,one);
+			V = _mm512_srli_epi64(V,1);
+			if (!m) continue;
+			p = ctx->pub_32[o+i];
+			for (k=0; k<n; k++)
+				acc[k] = _mm512_mask_add_epi64(acc[k], m, acc[k],
+						_mm512_set1_epi64(p[k]));
+		}
+	}
+
+	for (k=0; k<n; k++) _mm512_storeu_si512(t[k], acc[k]);
+	for (j=0; j<8; j++) enc_carry(&t[0][j], 8, n, dest[j]);
+}
+#endif
+
+static void (*enc_kernel)( const ks_ctx *ctx, const uint8_t *d,
+		uint1024 *dest );
+static int8_t enc_lanes;	/* blocks per enc_kernel call */
+static pthread_once_t enc_once = PTHREAD_ONCE_INIT;
+
+/*
+ * picks the widest kernel this CPU runs
+ */
+static void enc_pick(void) {
+	enc_lanes = 1;
+#if ENC_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		enc_kernel = encrypt8_avx512; enc_lanes = 8;
+	} else if (__builtin_cpu_supports("avx2")) {
+		enc_kernel = encrypt4_avx2; enc_lanes = 4;
+	}
+#endif
+}
+
+int	ks_encrypt_lanes	( void ) {
+	pthread_once(&enc_once, enc_pick);
+	return(enc_lanes);
+}
+
+void	ks_encryptn	( const ks_ctx *ctx, const void *data, int n,
+		uint1024 *dest ) {
+	const uint8_t *d = data;
+
+	pthread_once(&enc_once, enc_pick);
+	if (!ctx->enc_window && enc_lanes>1)
+		for (; n>=enc_lanes; n-=enc_lanes) {
+			enc_kernel(ctx, d, dest);
+			d += enc_lanes*ITEMS/8; dest += enc_lanes;
+		}
+	for (; n>0; n--) {
+		ks_encrypt(ctx, d, *dest);
+		d += ITEMS/8; dest++;
 	}
 }
 
@@ -294,25 +740,253 @@ void encrypt	( const void *data, uint1024 dest ) {
 
 
 /*
- * returns decrypted first ITEMS bites of data
+ * D = A-B-b, b = borrow out; with x86 intrinsics borrows go through
+ * the carry flag instead of a 128-bit temporary
  */
-void  	decrypt	( const uint1024 data, void *dest) {
+#if DEC_SIMD
+#define SBB(b,A,B,D) { unsigned long long _d; \
+		b = _subborrow_u64(b, A, B, &_d); D = _d; }
+#else
+#define SBB(b,A,B,D) { unsigned __int128 _c = \
+		(unsigned __int128) (A) - (B) - b; \
+		D = _c; b = (_c>>64)&1; }
+#endif
+
+/*
+ * table o holds all 256 subset sums of items 8*o .. 8*o+7, entry x is
+ * the sum of items whose bits are set in x; private key is
+ * superincreasing, so the entries grow with x and byte o of plaintext
+ * is the biggest x whose entry fits into what is left of dat
+ * entries have as many limbs as the sum of items 0 .. 8*o+7 (an upper
+ * bound of dat before byte o is found), they are packed one after
+ * another
+ */
+static void build_dec_table ( ks_ctx *ctx ) {
+	uint1024 S[256], pre;
+	uint64_t *T = ctx->dec_table;
+	int o,x,L;
+
+	uint_to_1024(pre,0);
+	for (o=0; o<ITEMS/8; o++) {
+		uint_to_1024(S[0],0);
+		for (x=1; x<256; x++) {
+			cpy1024(S[x], S[x & (x-1)]);
+			add1024(S[x], ctx->private_key[8*o+__builtin_ctz(x)]);
+		}
+		add1024(pre, S[255]);
+		L = limbs(pre, __SZ1024);
+		if (!L) L=1;
+
+		ctx->dec_off[o] = T-ctx->dec_table; ctx->dec_len[o] = L;
+		for (x=0; x<256; x++, T+=L) memcpy(T, S[x], L*sizeof(uint64_t));
+	}
+}
+
+int	ks_set_dec_tables	( ks_ctx *ctx, int on ) {
+	uint64_t *T=0;
+
+	if (on && !ctx->dec_table &&
+	    !(T=malloc(sizeof(uint1024)*256*(ITEMS/8))))
+		return(1);
+
+	if (!on) { free(ctx->dec_table); ctx->dec_table=0; return(0); }
+	if (T) ctx->dec_table = T;
+	build_dec_table(ctx);
+	return(0);
+}
+
+/*
+ * window j of comb_table holds d*u*2^(w*j) mod m for all w-bit digits d
+ * of ciphertext, so c*u is the sum of one entry per window; the sum
+ * of K entries is below K*m, its bits from b=bits(m) up (h) are
+ * folded back by comb_red[h] = h*2^b mod m; all entries have comb_len
+ * limbs
+ */
+static void build_comb_table ( ks_ctx *ctx ) {
+	uint1024 x,y,z;
+	uint64_t *T=ctx->comb_table;
+	int j,k,L,w;
+
+	w = ctx->comb_w;
+	L = ctx->comb_len = limbs(ctx->m, __SZ1024);
+	ctx->comb_b = bits1024(ctx->m);
+	if (!L) return;
+
+	cpy1024(x, ctx->u);
+	if (cmp1024(x, ctx->m)>=0) divmod1024(x, ctx->m, 0, x);
+	for (j=0; j<COMB_WINDOWS(w); j++) {
+		T = ctx->comb_table + ((j<<w)*L);
+		uint_to_1024(y, 0);
+		for (k=0; k<1<<w; k++, T+=L) {
+			memcpy(T, y, L*sizeof(uint64_t));
+			add1024(y, x);
+			if (cmp1024(y, ctx->m)>=0) sub1024(y, ctx->m);
+		}
+		shl1024(x, w);
+		divmod1024(x, ctx->m, 0, x);
+	}
+
+	/* 2^b mod m = 2^b-m, as 2^(b-1) <= m < 2^b */
+	uint_to_1024(z, 0);
+	z[ctx->comb_b/64] = 1ULL << ctx->comb_b%64;
+	sub1024(z, ctx->m);
+	uint_to_1024(y, 0);
+	ctx->comb_red = T;
+	for (k=0; k<COMB_WINDOWS(w); k++, T+=L) {
+		memcpy(T, y, L*sizeof(uint64_t));
+		add1024(y, z);
+		if (cmp1024(y, ctx->m)>=0) sub1024(y, ctx->m);
+	}
+}
+
+int	ks_set_dec_comb	( ks_ctx *ctx, int w ) {
+	uint64_t *T=0;
+
+	if (w<0) w = (ctx->m[0]&1) ? 0 : 8;
+	if (w>10) return(1);
+	if (w && !(T=malloc(sizeof(uint1024)*COMB_WINDOWS(w)*((1<<w)+1))))
+		return(1);
+
+	free(ctx->comb_table);
+	ctx->comb_table = T; ctx->comb_w = w;
+	if (w) build_comb_table(ctx);
+	return(0);
+}
+
+/*
+ * A = A*u mod m, with comb_table
+ */
+static void comb_mul ( const ks_ctx *ctx, uint1024 A ) {
+	uint64_t acc[__SZ1024+1], h;
+	const uint64_t *q;
+	unsigned __int128 c;
+	int i,j,k,n,w,L;
+
+	w = ctx->comb_w; L = ctx->comb_len;
+	memset(acc, 0, sizeof(acc));
+	n = 64*limbs(A, __SZ1024);
+
+	for (i=0, j=0; i<n; i+=w, j++) {
+		k = i/64;
+		h = A[k] >> i%64;
+		if (i%64+w>64 && k+1<__SZ1024) h |= A[k+1] << (64-i%64);
+		h &= (1<<w)-1;
+		if (!h) continue;
+
+		q = ctx->comb_table + ((j<<w)+h)*L;
+		for (k=0, c=0; k<L; k++) {
+			c += (unsigned __int128) acc[k] + q[k];
+			acc[k] = c; c >>= 64;
+		}
+		acc[L] += c;
+	}
+
+	/* acc < j*m, fold bits above b */
+	k = ctx->comb_b/64;
+	h = acc[k] >> ctx->comb_b%64;
+	if (ctx->comb_b%64) {
+		h |= acc[k+1] << (64-ctx->comb_b%64);
+		acc[k] &= (1ULL << ctx->comb_b%64)-1;
+		k++;
+	}
+	for (; k<=L; k++) acc[k]=0;
+
+	q = ctx->comb_red + h*L;
+	for (k=0, c=0; k<L; k++) {
+		c += (unsigned __int128) acc[k] + q[k];
+		acc[k] = c; c >>= 64;
+	}
+	acc[L] = c;
+
+	/* acc < 3m */
+	uint_to_1024(A, 0);
+	memcpy(A, acc, (L+1)*sizeof(uint64_t));
+	while (cmp1024(A, ctx->m)>=0) sub1024(A, ctx->m);
+}
+
+/*
+ * greedy phase over dec_table: one binary search (8 compares) and one
+ * subtraction per byte instead of 8 of each per byte; compares go from
+ * the top limb down and nearly always end at the first one
+ */
+static void decrypt_bytes ( const ks_ctx *ctx, uint1024 dat,
+		uint8_t *buff ) {
+	const uint64_t *T,*q;
+	uint64_t b;
+	int j,o,s,x,L,n;
+
+	n = limbs(dat, __SZ1024);
+	for (o=ITEMS/8-1; o>=0; o--) {
+		L = ctx->dec_len[o]; T = ctx->dec_table + ctx->dec_off[o];
+		if (n>L) n = limbs(dat, n);
+		if (n>L)
+			/* damaged ciphertext, dat is above all entries */
+			x = 255;
+		else for (x=0, s=128; s; s>>=1) {
+			q = T + (x+s)*L;
+			for (j=L-1; j && dat[j]==q[j]; j--);
+			x += s & -(uint64_t)(dat[j]>=q[j]);
+		}
+
+		q = T + x*L; b=0;
+		for (j=0; j<L; j++) SBB(b, dat[j], q[j], dat[j]);
+		for (; b; j++) b = !dat[j]--;
+		n = n>L ? limbs(dat, n) : L;
+		buff[o] = x;
+	}
+}
+
+/*
+ * greedy phase of decryption, dat = data*u mod m
+ */
+static void dec_greedy ( const ks_ctx *ctx, uint1024 dat, void *dest ) {
 	uint8_t  t, buff[ITEMS/8];
 	int16_t i,o;
-	uint1024 dat;
+	const uint64_t *p;
+	uint64_t d[__SZ1024],x,b;
+	unsigned __int128 c;
+	int j,k,n;
 
-	if (zero1024(u) || zero1024(m)) { dest=0; return; }
-	
-	cpy1024(dat,data);
-	mul1024modN(dat,u,m);
+	if (ctx->dec_table) {
+		decrypt_bytes(ctx, dat, buff);
+		bcopy(buff, dest, ITEMS/8);
+		return;
+	}
 
 	o=ITEMS/8; t=0;
+	n = limbs(dat, __SZ1024);
 
+	/*
+	 * only significant limbs of the items (k) take part: before item
+	 * i is tried, dat is below item i+1, so it has k+1 limbs at most
+	 * (unless the ciphertext is damaged); n is an upper bound of dat's
+	 * length, recounted only when items get shorter
+	 * dat-item is computed always and kept if it didn't borrow, the
+	 * outcome is a coin toss and would mispredict a branch
+	 */
 	for (i=ITEMS-1; i>=0; i--) {
 		t<<=1;
-		if (cmp1024(dat,private_key[i])>=0) {
-			t|=1;
-			sub1024(dat, private_key[i]);
+		k = ctx->priv_n[i]; p = ctx->priv_p[i];
+		if (n>k+1) n = limbs(dat, n);
+		if (n<=k+1) {
+			b=0;
+			for (j=0; j<k; j++) SBB(b, dat[j], p[j], d[j]);
+			SBB(b, dat[k], 0, d[k]);
+
+			x = b-1;
+			for (j=0; j<=k; j++) dat[j] = (d[j]&x) | (dat[j]&~x);
+			t |= !b;
+			n = k+1;
+		} else {
+			/* dat is longer than item, surely bigger */
+			b=0;
+			for (j=0; j<k; j++) {
+				c = (unsigned __int128) dat[j] - p[j] - b;
+				dat[j] = c; b = (c>>64)&1;
+			}
+			for (; b; j++) b = !dat[j]--;
+			t |= 1;
+			n = limbs(dat, n);
 		}
 		
 		if (i%8==0) {
@@ -324,3 +998,395 @@ void  	decrypt	( const uint1024 data, void *dest) {
 	bcopy(buff, dest, ITEMS/8);
 }
 
+/*
+ * returns decrypted first ITEMS bites of data
+ */
+void  	ks_decrypt	( const ks_ctx *ctx, const uint1024 data, void *dest) {
+	uint1024 dat;
+
+	if (zero1024(ctx->u) || zero1024(ctx->m)) { dest=0; return; }
+	
+	cpy1024(dat,data);
+	if (ctx->comb_w)
+		comb_mul(ctx, dat);
+	else if (ctx->m_odd)
+		mont_mul1024(&ctx->m_mont, dat, ctx->u_mont);
+	else
+		mul1024modN(dat,ctx->u,ctx->m);
+
+	dec_greedy(ctx, dat, dest);
+}
+
+
+
+/*
+ * multi-block decryption: u*c mod m of several blocks is computed side
+ * by side in SIMD lanes, the greedy phase follows block by block
+ */
+
+/*
+ * D[0..K-1] = r-bit digits of A, s apart
+ */
+static void split_radix ( const uint64_t *A, int r, int K, uint64_t *D,
+		int s ) {
+	int i,j,o;
+
+	for (i=0, o=0; i<K; i++, o+=r) {
+		j = o/64;
+		D[i*s] = A[j] >> o%64;
+		if (o%64+r>64 && j+1<__SZ1024) D[i*s] |= A[j+1] << (64-o%64);
+		D[i*s] &= (1ULL<<r)-1;
+	}
+}
+
+/*
+ * A = sum of D[i*s] << r*i for K digits bigger than r bits (not carried
+ * yet), then A<2m is reduced below m
+ */
+static void join_radix ( const ks_ctx *ctx, const uint64_t *D, int r,
+		int K, int s, uint1024 A ) {
+	uint64_t c=0,x;
+	int i,o,j;
+
+	uint_to_1024(A, 0);
+	for (i=0, o=0; i<=K; i++, o+=r) {
+		c += D[i*s];
+		x = c & ((1ULL<<r)-1);
+		c >>= r;
+		j = o/64;
+		A[j] |= x << o%64;
+		if (o%64+r>64 && j+1<__SZ1024) A[j+1] |= x >> (64-o%64);
+	}
+	if (cmp1024(A, ctx->m)>=0) sub1024(A, ctx->m);
+}
+
+static void prep_radix ( ks_ctx *ctx, struct mont_radix *P, int r ) {
+	uint1024 x;
+	int i;
+
+	P->r = r;
+	P->K = (bits1024(ctx->m)+8+r-1)/r;
+	if (P->K>MONT_MAXK) P->K = MONT_MAXK;
+	split_radix(ctx->m, r, P->K, P->n, 1);
+	P->n0 = ctx->m_mont.n0 & ((1ULL<<r)-1);
+
+	cpy1024(x, ctx->u);
+	if (cmp1024(x, ctx->m)>=0) divmod1024(x, ctx->m, 0, x);
+	for (i=0; i<P->K; i++) {
+		shl1024(x, r);
+		divmod1024(x, ctx->m, 0, x);
+	}
+	split_radix(x, r, P->K, P->b, 1);
+}
+
+#if DEC_SIMD
+/*
+ * 8 blocks with AVX-512 IFMA, 52-bit digits: vpmadd52luq/huq add the
+ * low/high half of a 104-bit product; digits of T are carried only
+ * when they leave through T[0] (K<=20 rounds of 4 products stay far
+ * below 2^64)
+ */
+__attribute__((target("avx512f,avx512ifma")))
+static void mont8_ifma ( const ks_ctx *ctx, const uint1024 *c,
+		uint1024 *dest ) {
+	const struct mont_radix *P = &ctx->mont52;
+	__m512i T[MONT_MAXK+1], a, q, x;
+	const __m512i zero = _mm512_setzero_si512(),
+		n0 = _mm512_set1_epi64(P->n0);
+	uint64_t A[MONT_MAXK][8], t[MONT_MAXK+1][8];
+	int i,j,k,K = P->K;
+
+	for (j=0; j<8; j++) split_radix(c[j], 52, K, &A[0][j], 8);
+	for (k=0; k<=K; k++) T[k] = zero;
+
+	for (i=0; i<K; i++) {
+		a = _mm512_loadu_si512(A[i]);
+		for (k=0; k<K; k++) {
+			x = _mm512_set1_epi64(P->b[k]);
+			T[k] = _mm512_madd52lo_epu64(T[k], a, x);
+			T[k+1] = _mm512_madd52hi_epu64(T[k+1], a, x);
+		}
+		q = _mm512_madd52lo_epu64(zero, T[0], n0);
+		for (k=0; k<K; k++) {
+			x = _mm512_set1_epi64(P->n[k]);
+			T[k] = _mm512_madd52lo_epu64(T[k], q, x);
+			T[k+1] = _mm512_madd52hi_epu64(T[k+1], q, x);
+		}
+		T[1] = _mm512_add_epi64(T[1], _mm512_srli_epi64(T[0], 52));
+		for (k=0; k<K; k++) T[k] = T[k+1];
+		T[K] = zero;
+	}
+
+	for (k=0; k<=K; k++) _mm512_storeu_si512(t[k], T[k]);
+	for (j=0; j<8; j++) join_radix(ctx, &t[0][j], 52, K, 8, dest[j]);
+}
+
+/*
+ * 4 blocks with AVX2, 28-bit digits: vpmuludq gives whole 56-bit
+ * products, K<=37 rounds of 2 of them stay below 2^64
+ */
+__attribute__((target("avx2")))
+static void mont4_avx2 ( const ks_ctx *ctx, const uint1024 *c,
+		uint1024 *dest ) {
+	const struct mont_radix *P = &ctx->mont28;
+	__m256i T[MONT_MAXK+1], a, q;
+	const __m256i zero = _mm256_setzero_si256(),
+		n0 = _mm256_set1_epi64x(P->n0),
+		msk = _mm256_set1_epi64x((1<<28)-1);
+	uint64_t A[MONT_MAXK][4], t[MONT_MAXK+1][4];
+	int i,j,k,K = P->K;
+
+	for (j=0; j<4; j++) split_radix(c[j], 28, K, &A[0][j], 4);
+	for (k=0; k<=K; k++) T[k] = zero;
+
+	for (i=0; i<K; i++) {
+		a = _mm256_loadu_si256((const __m256i *) A[i]);
+		for (k=0; k<K; k++)
+			T[k] = _mm256_add_epi64(T[k], _mm256_mul_epu32(a,
+					_mm256_set1_epi64x(P->b[k])));
+		q = _mm256_and_si256(_mm256_mul_epu32(T[0], n0), msk);
+		for (k=0; k<K; k++)
+			T[k] = _mm256_add_epi64(T[k], _mm256_mul_epu32(q,
+					_mm256_set1_epi64x(P->n[k])));
+		T[1] = _mm256_add_epi64(T[1], _mm256_srli_epi64(T[0], 28));
+		for (k=0; k<K; k++) T[k] = T[k+1];
+		T[K] = zero;
+	}
+
+	for (k=0; k<=K; k++) _mm256_storeu_si256((__m256i *) t[k], T[k]);
+	for (j=0; j<4; j++) join_radix(ctx, &t[0][j], 28, K, 4, dest[j]);
+}
+#endif
+
+static void (*dec_kernel)( const ks_ctx *ctx, const uint1024 *c,
+		uint1024 *dest );
+static int8_t dec_r;		/* digit bits of dec_kernel (mont52/mont28) */
+static int8_t dec_lanes;	/* blocks per dec_kernel call */
+static pthread_once_t dec_once = PTHREAD_ONCE_INIT;
+
+/*
+ * picks the widest kernel this CPU can run
+ */
+static void dec_pick(void) {
+	dec_lanes = 1;
+#if DEC_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512ifma")) {
+		dec_kernel = mont8_ifma; dec_r = 52; dec_lanes = 8;
+	} else if (__builtin_cpu_supports("avx2")) {
+		dec_kernel = mont4_avx2; dec_r = 28; dec_lanes = 4;
+	}
+#endif
+}
+
+int	ks_decrypt_lanes	( void ) {
+	pthread_once(&dec_once, dec_pick);
+	return(dec_lanes);
+}
+
+void	ks_decryptn	( const ks_ctx *ctx, const uint1024 *data, int n,
+		void *dest ) {
+	const struct mont_radix *P;
+	uint1024 dat[8];
+	uint8_t *d = dest;
+	int j,l,R;
+
+	pthread_once(&dec_once, dec_pick);
+	l = dec_lanes;
+	if (l>1 && ctx->m_odd && !ctx->comb_w && !zero1024(ctx->u)) {
+		P = dec_r==52 ? &ctx->mont52 : &ctx->mont28;
+		R = P->r * P->K;
+		for (; n>=l; n-=l) {
+			dec_kernel(ctx, data, dat);
+			for (j=0; j<l; j++, d+=ITEMS/8)
+				/* damaged ciphertext above R goes alone */
+				if (bits1024(data[j])>R) ks_decrypt(ctx, data[j], d);
+				else dec_greedy(ctx, dat[j], d);
+			data += l;
+		}
+	}
+	for (; n>0; n--) {
+		ks_decrypt(ctx, *data, d);
+		data++; d += ITEMS/8;
+	}
+}
+
+
+
+
+/***********************************************************
+ *			Byte blocks
+ ***********************************************************/
+
+#define KS_CHUNK 64	/* blocks converted on the stack at once */
+
+int	ks_api_version	( void ) {
+	return(KS_API_VERSION);
+}
+
+void	ks_encrypt_blocks	( const ks_ctx *ctx, const uint8_t *in, size_t n,
+		uint8_t *out ) {
+	uint1024 c[KS_CHUNK];
+	int i,k;
+
+	for (; n>0; n-=k) {
+		k = n<KS_CHUNK ? n : KS_CHUNK;
+		ks_encryptn(ctx, in, k, c);
+		for (i=0; i<k; i++, out+=KS_CIPHER_BLOCK) store1024(out, c[i]);
+		in += k*KS_PLAIN_BLOCK;
+	}
+}
+
+void	ks_decrypt_blocks	( const ks_ctx *ctx, const uint8_t *in, size_t n,
+		uint8_t *out ) {
+	uint1024 c[KS_CHUNK];
+	int i,k;
+
+	for (; n>0; n-=k) {
+		k = n<KS_CHUNK ? n : KS_CHUNK;
+		for (i=0; i<k; i++, in+=KS_CIPHER_BLOCK) load1024(in, c[i]);
+		ks_decryptn(ctx, c, k, out);
+		out += k*KS_PLAIN_BLOCK;
+	}
+}
+
+
+
+
+/***********************************************************
+ *			Streams
+ ***********************************************************/
+
+/*
+ * a stream has the layout of encrypted files written to a pipe:
+ * KS_STREAM, the blocks and r; a partial block of input is kept in
+ * the state until the rest of it comes, whole blocks go straight from
+ * in to out
+ */
+void	ks_enc_init	( ks_enc_t *s, const ks_ctx *ctx ) {
+	s->ctx = ctx;
+	s->npart = 0;
+	s->r = 0;
+	s->head = 0;
+}
+
+size_t	ks_enc_update	( ks_enc_t *s, const void *in, size_t n,
+		uint8_t *out ) {
+	const uint8_t *d = in;
+	uint8_t *o = out;
+	size_t k;
+
+	if (!n) return(0);
+	if (!s->head) { *o++ = KS_STREAM; s->head = 1; }
+
+	if (s->npart) {
+		k = KS_PLAIN_BLOCK - s->npart;
+		if (k>n) k=n;
+		memcpy(s->part + s->npart, d, k);
+		s->npart += k; d += k; n -= k;
+		if (s->npart<KS_PLAIN_BLOCK) return(o-out);
+		ks_encrypt_blocks(s->ctx, s->part, 1, o);
+		o += KS_CIPHER_BLOCK; s->npart = 0;
+		s->r = KS_PLAIN_BLOCK;
+	}
+
+	k = n/KS_PLAIN_BLOCK;
+	if (k) {
+		ks_encrypt_blocks(s->ctx, d, k, o);
+		o += k*KS_CIPHER_BLOCK; d += k*KS_PLAIN_BLOCK;
+		s->r = KS_PLAIN_BLOCK;
+	}
+	s->npart = n%KS_PLAIN_BLOCK;
+	memcpy(s->part, d, s->npart);
+	return(o-out);
+}
+
+size_t	ks_enc_final	( ks_enc_t *s, uint8_t *out ) {
+	uint8_t *o = out;
+
+	if (!s->head) { *o++ = KS_STREAM; s->head = 1; }
+	if (s->npart) {
+		/* the last block, filled up by zeros */
+		memset(s->part + s->npart, 0, KS_PLAIN_BLOCK - s->npart);
+		ks_encrypt_blocks(s->ctx, s->part, 1, o);
+		o += KS_CIPHER_BLOCK;
+		s->r = s->npart; s->npart = 0;
+	}
+	*o++ = s->r;
+	return(o-out);
+}
+
+/*
+ * the plaintext of the last block is kept until the end, as only r
+ * tells how much of it belongs to the data; in a stream r is the byte
+ * left after the blocks
+ */
+void	ks_dec_init	( ks_dec_t *s, const ks_ctx *ctx ) {
+	s->ctx = ctx;
+	s->npart = 0;
+	s->have = 0;
+	s->head = -1;
+	s->err = 0;
+}
+
+/*
+ * out = the block kept before, then plaintext of n blocks from in but
+ * the last one, which is kept instead
+ */
+static uint8_t *dec_hold ( ks_dec_t *s, const uint8_t *in, size_t n,
+		uint8_t *out ) {
+	if (s->have) {
+		memcpy(out, s->last, KS_PLAIN_BLOCK);
+		out += KS_PLAIN_BLOCK;
+	}
+	ks_decrypt_blocks(s->ctx, in, n-1, out);
+	ks_decrypt_blocks(s->ctx, in + (n-1)*KS_CIPHER_BLOCK, 1, s->last);
+	s->have = 1;
+	return(out + (n-1)*KS_PLAIN_BLOCK);
+}
+
+size_t	ks_dec_update	( ks_dec_t *s, const uint8_t *in, size_t n,
+		void *out ) {
+	uint8_t *o = out;
+	size_t k;
+
+	if (n && s->head<0) { s->head = *in++; n--; }
+
+	if (s->npart) {
+		k = KS_CIPHER_BLOCK - s->npart;
+		if (k>n) k=n;
+		memcpy(s->part + s->npart, in, k);
+		s->npart += k; in += k; n -= k;
+		if (s->npart<KS_CIPHER_BLOCK) return(o-(uint8_t *) out);
+		o = dec_hold(s, s->part, 1, o);
+		s->npart = 0;
+	}
+
+	k = n/KS_CIPHER_BLOCK;
+	if (k) {
+		o = dec_hold(s, in, k, o);
+		in += k*KS_CIPHER_BLOCK;
+	}
+	s->npart = n%KS_CIPHER_BLOCK;
+	memcpy(s->part, in, s->npart);
+	return(o-(uint8_t *) out);
+}
+
+size_t	ks_dec_final	( ks_dec_t *s, void *out ) {
+	int r = s->head<0 ? 0 : s->head;
+
+	if (r==KS_STREAM) {
+		if (s->npart!=1 || s->part[0]>KS_PLAIN_BLOCK) {
+			s->err = 1;	/* truncated stream */
+			return(0);
+		}
+		r = s->part[0];
+	}
+	s->npart = 0;
+
+	if (r>KS_PLAIN_BLOCK) r=KS_PLAIN_BLOCK;	/* damaged header */
+	if (!s->have) return(0);
+	s->have = 0;
+	memcpy(out, s->last, r);
+	return(r);
+}
@@ -22,47 +22,254 @@
 #ifndef __KS_CRYPT_H__ 
 #define __KS_CRYPT_H__
 
-#include  "uint1024.h"
+#include <stddef.h>
+#include <stdint.h>
 
 #define ITEMS 256
-typedef 	uint1024 	kskey_t[ITEMS];
 
-kskey_t 	private_key, 
-		public_key;
-uint1024	u,v,m;
+typedef		uint64_t	ks_block_t[17];
+	/* a block of ciphertext as a number, the same as uint1024 of
+	   uint1024.h (16 64-bit digits + 1 guard digit) */
+
+/*
+ * encrypted files start with byte r, the number of bytes in the last
+ * block (0 for empty input), followed by blocks of 33 32-bit words;
+ * if r couldn't be written first (output is a pipe), the file starts
+ * with KS_STREAM instead and r follows the last block
+ */
+#define KS_STREAM 0xff
+
+#define KS_PLAIN_BLOCK	(ITEMS/8)
+	/* bytes of plaintext per block */
+#define KS_CIPHER_BLOCK	132
+	/* bytes of ciphertext per block, as in files; every number in key
+	   files takes as many */
+
+#define KS_API_VERSION 1
+	/* version of the ks_* interface, it is raised whenever a change
+	   breaks programs using it (libkscrypt.so.KS_API_VERSION) */
+
+/*
+ * returns KS_API_VERSION of the library
+ */
+int		ks_api_version	( void );
+
+/*
+ * a context holds one key (private, public or both) and the tables
+ * precomputed from it; contexts are independent, so threads may use
+ * different keys at once, and encryption/decryption only reads the
+ * context, so threads may share one as well; functions changing it
+ * (ks_gen_*, ks_load_*, ks_set_*) must not run beside others on the
+ * same context
+ */
+typedef struct ks_ctx ks_ctx;
+
+/*
+ * returns a new context without keys, 0 if there is not enough memory
+ */
+ks_ctx *	ks_ctx_new	( void );
+
+/*
+ * frees ctx with its tables
+ */
+void		ks_ctx_free	( ks_ctx *ctx );
 
 /*
  * generates {private_key, u, v, m}
  */
-void 		gen_priv_key	( const unsigned int seed );
+void 		ks_gen_priv_key	( ks_ctx *ctx, const unsigned int seed );
+
+/*
+ * sets number of threads ks_gen_pub_key() may use (1 by default); the
+ * keys don't depend on it
+ * returns non-zero if n<1
+ */
+int		ks_set_threads	( ks_ctx *ctx, int n );
 
 /*
  * writes/reads {private_key, u, m} to/from specified file
  */
-int		store_priv_key	( const char *file_name );
-int		load_priv_key	( const char *file_name );
+int		ks_store_priv_key	( const ks_ctx *ctx, const char *file_name );
+int		ks_load_priv_key	( ks_ctx *ctx, const char *file_name );
+
+/*
+ * the same as the files in memory, buf holds KS_PRIV_KEY_SIZE or
+ * KS_PUB_KEY_SIZE bytes
+ */
+#define KS_PRIV_KEY_SIZE	((ITEMS+2)*KS_CIPHER_BLOCK)
+#define KS_PUB_KEY_SIZE		(ITEMS*KS_CIPHER_BLOCK)
+
+void		ks_priv_key_bytes	( const ks_ctx *ctx, uint8_t *buf );
+void		ks_pub_key_bytes	( const ks_ctx *ctx, uint8_t *buf );
 
 /*
  * generates public_key from {private_key, v, m}
  */
-void		gen_pub_key	( void );
+void		ks_gen_pub_key	( ks_ctx *ctx );
 
 /*
  * writes/reads public_key to/from specified file
  */
-int		store_pub_key	( const char *file_name );
-int		load_pub_key	( const char *file_name );
+int		ks_store_pub_key	( const ks_ctx *ctx, const char *file_name );
+int		ks_load_pub_key	( ks_ctx *ctx, const char *file_name );
 
 
+/*
+ * precomputes subset sums of public_key for w-bit windows of plaintext,
+ * so that ks_encrypt() needs ITEMS/w additions instead of one per set
+ * bit; the tables take (ITEMS/w)*2^w numbers (about 1MB for w=8), w=0
+ * switches them off; they follow ks_gen_pub_key() and ks_load_pub_key()
+ * returns non-zero if w>16 or there is not enough memory
+ */
+int		ks_set_enc_window	( ks_ctx *ctx, int w );
+
 /*
  * returns encrypted first ITEMS bites of data
  */
-void		encrypt		( const void *data, uint1024 dest );
+void		ks_encrypt	( const ks_ctx *ctx, const void *data,
+				  ks_block_t dest );
+
+/*
+ * encrypts n consecutive blocks of ITEMS bits from data to dest[0..n-1],
+ * several blocks at once where the CPU has AVX2 or AVX-512
+ */
+void		ks_encryptn	( const ks_ctx *ctx, const void *data, int n,
+				  ks_block_t *dest );
+
+/*
+ * returns number of blocks ks_encryptn() encrypts at once without
+ * tables (1 if there is no multi-block kernel for this CPU)
+ */
+int		ks_encrypt_lanes	( void );
+
+/*
+ * precomputes all 256 subset sums of every 8 private key items, so that
+ * ks_decrypt() finds each byte by binary search (8 compares, 1
+ * subtraction) instead of trying all ITEMS items; the tables take up to
+ * 1MB, on=0 frees them; they follow ks_gen_priv_key() and
+ * ks_load_priv_key()
+ * returns non-zero if there is not enough memory
+ */
+int		ks_set_dec_tables	( ks_ctx *ctx, int on );
+
+/*
+ * precomputes d*u*2^(w*j) mod m for every w-bit digit d of ciphertext
+ * at every position j, so that ks_decrypt() multiplies by u with one
+ * addition per digit and a final reduction instead of a modular
+ * multiplication; the tables take (1088/w)*2^w numbers as long as m
+ * (about 400KB for w=4, 3MB for w=8 and 650-bit m), w=0 switches them
+ * off; they follow ks_gen_priv_key() and ks_load_priv_key()
+ * ks_decrypt() multiplies in Montgomery form when m is odd, which is
+ * faster than any w; the tables pay off for keys with even m, so w<0
+ * picks 8 for them and 0 otherwise
+ * returns non-zero if w>10 or there is not enough memory
+ */
+int		ks_set_dec_comb	( ks_ctx *ctx, int w );
 
 /*
  * returns decrypted first ITEMS bites of data
  */
-void		decrypt	( const uint1024 data, void *dest );
+void		ks_decrypt	( const ks_ctx *ctx, const ks_block_t data,
+				  void *dest );
+
+/*
+ * decrypts n blocks data[0..n-1] to dest (n*ITEMS/8 bytes), multiplying
+ * several of them by u at once where the CPU has AVX-512 IFMA or AVX2
+ */
+void		ks_decryptn	( const ks_ctx *ctx, const ks_block_t *data,
+				  int n, void *dest );
+
+/*
+ * returns number of blocks ks_decryptn() multiplies at once (1 if
+ * there is no multi-block kernel for this CPU)
+ */
+int		ks_decrypt_lanes	( void );
+
+/*
+ * encrypts n blocks of KS_PLAIN_BLOCK bytes from in to n blocks of
+ * KS_CIPHER_BLOCK bytes in out, the layout of encrypted files; buffers
+ * are the caller's and need no alignment, nothing is allocated
+ */
+void		ks_encrypt_blocks	( const ks_ctx *ctx, const uint8_t *in,
+				  size_t n, uint8_t *out );
+
+/*
+ * decrypts n blocks of KS_CIPHER_BLOCK bytes from in to n blocks of
+ * KS_PLAIN_BLOCK bytes in out, the same way
+ */
+void		ks_decrypt_blocks	( const ks_ctx *ctx, const uint8_t *in,
+				  size_t n, uint8_t *out );
+
+
+/*
+ * streams: data given in pieces of any size, encrypted to the layout of
+ * encrypted files written to a pipe (KS_STREAM, the blocks, r) and
+ * back; whole blocks of a piece go to the block kernels straight from
+ * the caller's buffer, only a partial one is kept in the state
+ * the states are the caller's, their fields are private; the context
+ * must live until the final call
+ */
+typedef struct {
+	const ks_ctx	*ctx;
+	uint8_t		part[KS_PLAIN_BLOCK];	/* partial block of input */
+	int		npart;
+	uint8_t		r;	/* bytes in the last block written */
+	int8_t		head;	/* KS_STREAM is written */
+} ks_enc_t;
+
+typedef struct {
+	const ks_ctx	*ctx;
+	uint8_t		part[KS_CIPHER_BLOCK];	/* partial block of input */
+	int		npart;
+	uint8_t		last[KS_PLAIN_BLOCK];	/* plaintext of the last block */
+	int8_t		have;	/* last is valid */
+	int		head;	/* first byte of input, -1 before it */
+	int		err;	/* set by ks_dec_final() if truncated */
+} ks_dec_t;
 
+#define KS_ENC_OUT(n)	\
+	(1 + ((n)+KS_PLAIN_BLOCK-1)/KS_PLAIN_BLOCK*KS_CIPHER_BLOCK)
+	/* most bytes ks_enc_update() writes for n bytes of input */
+#define KS_ENC_FINAL	(KS_CIPHER_BLOCK+2)
+	/* most bytes ks_enc_final() writes */
+#define KS_DEC_OUT(n)	(((n)/KS_CIPHER_BLOCK+1)*KS_PLAIN_BLOCK)
+	/* most bytes ks_dec_update() writes for n bytes of input */
+
+/*
+ * starts encrypting a stream with ctx
+ */
+void		ks_enc_init	( ks_enc_t *s, const ks_ctx *ctx );
+
+/*
+ * encrypts n bytes of in, out must hold KS_ENC_OUT(n) bytes
+ * returns number of bytes written to out
+ */
+size_t		ks_enc_update	( ks_enc_t *s, const void *in, size_t n,
+				  uint8_t *out );
+
+/*
+ * ends the stream, out must hold KS_ENC_FINAL bytes
+ * returns number of bytes written to out
+ */
+size_t		ks_enc_final	( ks_enc_t *s, uint8_t *out );
+
+/*
+ * starts decrypting a stream or a whole file with ctx
+ */
+void		ks_dec_init	( ks_dec_t *s, const ks_ctx *ctx );
+
+/*
+ * decrypts n bytes of in, out must hold KS_DEC_OUT(n) bytes
+ * returns number of bytes written to out
+ */
+size_t		ks_dec_update	( ks_dec_t *s, const uint8_t *in, size_t n,
+				  void *out );
+
+/*
+ * writes the rest of plaintext (KS_PLAIN_BLOCK bytes at most) to out,
+ * sets s->err if a stream ends without its r
+ * returns number of bytes written to out
+ */
+size_t		ks_dec_final	( ks_dec_t *s, void *out );
 
 #endif /* ks_crypt.h */
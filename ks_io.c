@@ -0,0 +1,200 @@
+/***************************************************************************    
+*   Knapsack problem solving encryption - asymetric encryption based on
+*   NP-complete problem (Knapsack)
+*   Copyright (C) 2001 Miroslav 'Mirco' Bajtos
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA,
+*   or try <http://www.gnu.org>
+***************************************************************************/
+
+#include "ks_io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static ks_file_t *ks_new(int fd, int out) {
+	ks_file_t *f;
+
+	if (!(f = calloc(1, sizeof(ks_file_t)))) return(0);
+	f->fd = fd; f->out = out;
+	f->size = -1;
+	f->start = lseek(fd, 0, SEEK_CUR);
+	/* pwrite() would append anyway */
+	if (out && (fcntl(fd, F_GETFL) & O_APPEND)) f->start = -1;
+	return(f);
+}
+
+/*
+ * maps size bytes of f, advising sequential access
+ */
+static int ks_map(ks_file_t *f, off_t size) {
+	void *m;
+
+	if (size<=0) return(1);
+	m = mmap(0, size, f->out ? PROT_READ|PROT_WRITE : PROT_READ,
+			MAP_SHARED, f->fd, 0);
+	if (m==MAP_FAILED) return(1);
+
+	madvise(m, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(m, size, MADV_HUGEPAGE);
+#endif
+	f->map = m; f->size = size;
+	return(0);
+}
+
+static int ks_alloc_buf(ks_file_t *f) {
+	void *b;
+
+	if (posix_memalign(&b, 4096, KS_IO_BUF)) return(1);
+	f->buf = b;
+	return(0);
+}
+
+ks_file_t *ks_open_in(const char *file_name) {
+	ks_file_t *f;
+	struct stat st;
+	int fd;
+
+	if (file_name && strcmp(file_name,"-")) {
+		if ((fd = open(file_name, O_RDONLY))<0) return(0);
+	} else fd = 0;
+	if (!(f = ks_new(fd, 0))) { if (fd) close(fd); return(0); }
+
+	if (fd && !fstat(fd, &st) && S_ISREG(st.st_mode) &&
+			!ks_map(f, st.st_size)) return(f);
+
+	if (ks_alloc_buf(f)) { free(f); if (fd) close(fd); return(0); }
+	return(f);
+}
+
+ks_file_t *ks_open_out(const char *file_name, off_t size) {
+	ks_file_t *f;
+	struct stat st;
+	int fd;
+
+	if (file_name && strcmp(file_name,"-")) {
+		fd = open(file_name, O_RDWR|O_CREAT|O_TRUNC, 0666);
+		if (fd<0) return(0);
+	} else fd = 1;
+	if (!(f = ks_new(fd, 1))) { if (fd!=1) close(fd); return(0); }
+
+	/*
+	 * stdout may be appended to, map only files created here; the
+	 * blocks are allocated first, a full disk would raise SIGBUS in a
+	 * write to the map, write() reports it
+	 */
+	if (fd!=1 && size>0 && !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+		if (!posix_fallocate(fd, 0, size) && !ks_map(f, size))
+			return(f);
+		/* what was allocated before a failure */
+		if (ftruncate(fd, 0)) f->err = errno;
+	}
+
+	if (f->err || ks_alloc_buf(f)) {
+		free(f); if (fd!=1) close(fd);
+		return(0);
+	}
+	return(f);
+}
+
+size_t ks_read(ks_file_t *f, const uint8_t **p, size_t n) {
+	ssize_t r;
+
+	if (f->map) {
+		if (n > f->size - f->pos) n = f->size - f->pos;
+		*p = f->map + f->pos; f->pos += n;
+		return(n);
+	}
+
+	if (n>KS_IO_BUF) n=KS_IO_BUF;
+	if (f->len - f->pos < n) {
+		/* move the rest to the front and refill */
+		memmove(f->buf, f->buf + f->pos, f->len - f->pos);
+		f->len -= f->pos; f->pos = 0;
+		while (f->len < n && !f->eof && !f->err) {
+			r = read(f->fd, f->buf + f->len, KS_IO_BUF - f->len);
+			if (r>0) f->len += r;
+			else if (!r) f->eof = 1;
+			else if (errno!=EINTR) f->err = errno;
+		}
+		if (n > f->len) n = f->len;
+	}
+	*p = f->buf + f->pos; f->pos += n;
+	return(n);
+}
+
+/*
+ * writes out buffered output
+ */
+static void ks_flush(ks_file_t *f) {
+	size_t o=0;
+	ssize_t r;
+
+	while (o < f->pos && !f->err) {
+		r = write(f->fd, f->buf + o, f->pos - o);
+		if (r>=0) o += r;
+		else if (errno!=EINTR) f->err = errno;
+	}
+	f->pos = 0;
+}
+
+uint8_t *ks_wbuf(ks_file_t *f, size_t n) {
+	uint8_t *p;
+
+	if (f->err) return(0);
+	if (f->map) {
+		if (n > f->size - f->pos) { f->err = ENOSPC; return(0); }
+		p = f->map + f->pos;
+	} else {
+		if (n > KS_IO_BUF) { f->err = EINVAL; return(0); }
+		if (f->pos + n > KS_IO_BUF) ks_flush(f);
+		p = f->buf + f->pos;
+	}
+	f->pos += n;
+	return(p);
+}
+
+int ks_patch(ks_file_t *f, off_t off, const void *p, size_t n) {
+	if (f->map) {
+		if (off+n > f->size) return(1);
+		memcpy(f->map + off, p, n);
+		return(0);
+	}
+	if (f->start<0) return(1);
+	ks_flush(f);
+	if (f->err || pwrite(f->fd, p, n, f->start + off)!=n) return(1);
+	return(0);
+}
+
+int ks_close(ks_file_t *f) {
+	int r;
+
+	if (f->map) {
+		munmap(f->map, f->size);
+		/* the file was sized in advance */
+		if (f->out && f->pos < f->size && ftruncate(f->fd, f->pos))
+			f->err = errno;
+	} else if (f->out) ks_flush(f);
+
+	if (f->fd>1 && close(f->fd) && !f->err) f->err = errno;
+	r = f->err;
+	free(f->buf); free(f);
+	return(r!=0);
+}
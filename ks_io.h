@@ -0,0 +1,91 @@
+/***************************************************************************    
+*   Knapsack problem solving encryption - asymetric encryption based on
+*   NP-complete problem (Knapsack)
+*   Copyright (C) 2001 Miroslav 'Mirco' Bajtos
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA,
+*   or try <http://www.gnu.org>
+***************************************************************************/
+
+#ifndef __KS_IO_H__
+#define __KS_IO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * bulk file I/O for encrypt and decrypt: regular files are mmapped,
+ * pipes and terminals go through large aligned buffers; either way
+ * callers get pointers to contiguous runs of bytes, so blocks can be
+ * handed to the batch kernels without copying
+ */
+
+#define KS_IO_BUF	(4<<20)
+	/* size of buffers for pipes */
+
+typedef struct {
+	int		fd;
+	int		out;	/* opened for writing */
+	int		err;	/* errno of the first failure, 0 if none */
+	off_t		size;	/* size of mapped file, -1 if not mapped */
+	off_t		start;	/* offset of fd when opened, -1 if not
+				   seekable */
+	uint8_t		*map;	/* mapped file */
+	uint8_t		*buf;	/* buffer if not mapped */
+	size_t		pos;	/* next byte in map or buf */
+	size_t		len;	/* bytes in buf (input) */
+	int		eof;
+} ks_file_t;
+
+ks_file_t *	ks_open_in	( const char *file_name );
+		/*
+		 * opens file for reading, NULL or "-" means stdin
+		 * returns NULL if failed
+		 */
+
+ks_file_t *	ks_open_out	( const char *file_name, off_t size );
+		/*
+		 * creates file for writing, NULL or "-" means stdout; if size
+		 * is known (>=0) and the file is regular, it's mapped
+		 * returns NULL if failed
+		 */
+
+size_t		ks_read		( ks_file_t *f, const uint8_t **p, size_t n );
+		/*
+		 * points p to next n bytes of input and returns n; less only
+		 * at the end of input (0 there) or after an error
+		 */
+
+uint8_t *	ks_wbuf		( ks_file_t *f, size_t n );
+		/*
+		 * returns room for next n bytes of output (n<=KS_IO_BUF),
+		 * NULL after an error
+		 */
+
+int		ks_patch	( ks_file_t *f, off_t off, const void *p,
+				  size_t n );
+		/*
+		 * rewrites n bytes at off (relative to where output started),
+		 * returns non-zero if the output is not seekable or failed
+		 */
+
+int		ks_close	( ks_file_t *f );
+		/*
+		 * flushes and closes f
+		 * returns non-zero if any operation on f failed
+		 */
+
+#endif /* ks_io.h */
@@ -23,281 +23,21 @@
 #include "uint1024.h"
 
 #include <math.h>
+#include <strings.h>
 
 short verbose = 0;	/* from config.h */
 
-/*
- * representation of uint1024: u[0] is the lowest 'digit',
- * u[__SZ1024-2] is the highest 'digit', u[__SZ1024-1] is
- * used to catch overflows
- */
-
-
-/*
- *  A += B 
- *  returns 1 if A>2^1024 
- */
-int8_t	add1024 	( uint1024 A, const uint1024 B )  
-{
-	int8_t i;
-	uint64_t b;
-
-	for (i=0; i<__SZ1024-1; i++) {
-		b = B[i];
-		*((uint64_t *) (A+i)) += b;
-	}
- 
-	i = A[__SZ1024-1]?1:0;
-	A[__SZ1024-1] = 0;
-	
-	return (i);
-	
-}
-	
-
-/*
- *  A -= B 
- *  returns 1 if A<0 
- */
-int8_t	sub1024 	( uint1024 A, const uint1024 B )  
-{
-	int8_t i;
-	uint64_t a,b;
-	uint32_t r;
-
-	
-	r=0;
-	for (i=0; i<__SZ1024-1; i++) {
-		a = A[i];
-		b = B[i];
-		if (b+r) {
-			b+=r; r=0;
-			if (a<b) {
-				r = 1;
-				a += ((uint64_t) 1) << 32;
-			}
-			a-=b;
-			A[i]=a;
-			
-		}
-	}
-
-	return (r);
-	
-}
-
-void mod_n(uint1024 X, const uint1024 N) {
-	uint1024 m;
-	
-	cpy1024(m,N);
-	while (cmp1024(m,X)<0) { shl1024(m,1); }
-
-	while (cmp1024(X,N)>=0) {
-		while (cmp1024(m,X)>0) { shr1024(m,1); }
-		sub1024(X,m);
-	}
-}
-
-/*
- * A *= B (mod N)
- */
-void mul1024modN	( uint1024 A, const uint1024 B , const uint1024 N) {
-	uint1024 C,R,m;
-	uint64_t t;
-	uint8_t i,j,k;
-	
-	uint_to_1024(R,0); 
-	for (i=0; i<__SZ1024-1; i++) {
-		uint_to_1024(C,0);
-		for (j=0; j<__SZ1024-1; j++) {
-			t = A[j];
-			t *= B[i];
-		        *((uint64_t *) (C+j)) += t;
-		}
-		cpy1024(m,N);
-		mod_n(C,m);
-		
-		for (k=0; k<=i; k++) {
-			if (k) { shl1024(C, 32); }
-			/*if (C[__SZ1024-2])*/ mod_n(C,m);
-		}
-		add1024(R,C);
-		mod_n(R,m);
-		
-	}
-	cpy1024(A,R);
-
-}
-	
-
-
-
-
-/*  
- *  A = A >> s 
- */
-void  	shr1024 	( uint1024 A, uint16_t s )
-{
-	int8_t i;
-	uint32_t r,r2;
-	
-	r=s/32;
-	if (r) {
-		for (i=0; i<__SZ1024-r; i++) A[i]=A[i+r];
-		for (i=__SZ1024-r; i<__SZ1024; i++) A[i]=0;
-		s%=32;
-	}
-	
-	if (s) {
-		r=0;
-		for (i=__SZ1024-2; i>=0; i--) {
-			r2 = A[i] & ((1 << s) -1);
-			A[i] = (A[i] >> s) + (r << (32-s));
-			r = r2;
-		}
-	}
-}
-
-
-/*  
- *  A = A << s 
- */
-void  	shl1024 	( uint1024 A, uint16_t s )
-{
-	int8_t i;
-	uint32_t r,r2;
-
-#if DSHL1024
-	printf("Debugging shl1024(s=%hu)\n",s);
-	printf("A="); dump1024(A);
-#endif
-	
-	r=s/32;
-	if (r) {
-		for (i=__SZ1024-1; i>=r; i--) A[i]=A[i-r];
-		for (i=0; i<r; i++) A[i]=0;
-		s%=32;
-	}
-	
-	#if DSHL1024
-		printf("s=%hu",s);
-	#endif
-
-	if (s) {
-		r=0;
-		for (i=0; i<__SZ1024-1; i++) {
-			r2 = A[i] >> (32-s);
-			A[i] = (A[i] << s) + r;
-			r = r2;
-			#if DSHL1024
-				dump1024(A);
-			#endif
-		}
-	}
-	
-	#if DSHL1024
-		puts("leaving shl1024");
-	#endif
-}
-
-int
-	cmp1024		( const uint1024 A, const uint1024 B )
-{
-	int8_t i=__SZ1024-1;
-
-	while (i>=0) 
-		if (A[i]<B[i]) return(-1);
-		else if (A[i]>B[i]) return (1);
-		else i--;
-	return(0);
-}
-
-
-/*
- *  returns 1 if A=0, 0 otherwise
- */
-int8_t	zero1024	( const uint1024 A )
-{
-	uint8_t i;
-	
-	for (i=0; i<__SZ1024; i++)
-		if ( A[i] ) return (0);
-
-	return (1);
-
-}
-
-/* 
- * converts A as uint32_t to D as uint1024 uint1024
- */
-void  uint_to_1024	( uint1024 D, const uint32_t A ) {
-	uint8_t i;
-		
-	for (i=0; i<__SZ1024; i++)
-		D[i] = 0;
-	D[0] = A;
-	
-
-}
-
-
-/*
- * A = B
- */
-void	cpy1024		( uint1024 A, const uint1024 B ) {
-	uint8_t i;
-
-	for (i=0; i<__SZ1024; i++)
-		A[i]=B[i];
-
-}
-
-
-#include <strings.h>
-#include <stdio.h>
-
-/*
- * dumps A as array of uints
- */
-void dump1024	(const uint1024 A)
-{
-	uint8_t i;
-	for (i=0; i<__SZ1024; i++) 
-		printf("%u ",A[i]);
-	puts("\n");
-}
+#define UINT_BITS 1024
+#include "uintN.c"
+#undef UINT_BITS
 
 
 /* 
  * finds the GCD of A and B and result stores in G
+ * (Lehmer's algorithm, several times faster than binary one here)
  */
-
 void GCD(const uint1024 A, const uint1024 B, uint1024 G) {
-	uint1024 C,D;
-	if (cmp1024(A,B)>0) { cpy1024(C,A); cpy1024(D,B); }
-	else { cpy1024(C,B); cpy1024(D,A); }
-	
-	do {
-		cpy1024(G,C);
-		mod_n(G,D);
-		
-		cpy1024(C,D);
-		cpy1024(D,G);
-	} while (non_zero1024(G));
-
-	cpy1024(G,C);
-}
-
-
-/*
- * reads/writes x from/to stream
- * return non-zero if failed
- */
-int 	read1024	( FILE *stream, uint1024 x ) {
-	return ( fread(x, 32/8, __SZ1024, stream) != __SZ1024 );
-}
-int	write1024	( FILE *stream, const uint1024 x ) {
-	return ( fwrite(x, 32/8, __SZ1024, stream) != __SZ1024 );
+	gcd_lehmer1024(A,B,G);
 }
 
 
@@ -346,11 +86,11 @@ int testShr(uint32_t loop)
 	uint_to_1024 (A, 16777216);
 
 	while (1) { 
-		memcpy(B, A, __SZ1024*sizeof(uint32_t));
+		memcpy(B, A, sizeof(uint1024));
 		if (add1024(A,B)) break;
 	}
 	
-	memcpy(A,B, __SZ1024*sizeof(uint32_t));
+	memcpy(A,B, sizeof(uint1024));
 	dump1024(A);
 	while (loop--) {
 		/*if (sub1024(A,B)) puts("Negative:");*/
@@ -424,6 +164,399 @@ void test_GCD(int ArgC, char *ArgV[]) {
 	
 }
 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * fills A with random number of given bit length
+ */
+void rand1024(uint1024 A, unsigned int bits) {
+	uint8_t i;
+
+	for (i=0; i<__SZ1024; i++)
+		A[i] = random() ^ ((uint64_t) random()<<22) ^ ((uint64_t) random()<<44);
+	A[__SZ1024-1] = 0;
+	shr1024(A, 64*(__SZ1024-1)-bits);
+	A[(bits-1)/64] |= ((uint64_t) 1) << ((bits-1)%64);
+}
+
+/*
+ * compares mont_mul1024 with mul1024modN, both results and speed
+ */
+void bench_mulmod(int ArgC, char *ArgV[]) {
+	unsigned int bits, loops, i;
+	uint1024 N,A,B,C,D;
+	mont1024_t M;
+	clock_t t;
+	double t1,t2;
+
+	bits=650; loops=200;
+	if (ArgC>2) {
+		sscanf(ArgV[1], "%u", &bits);
+		sscanf(ArgV[2], "%u", &loops);
+	}
+
+	printf("Benchmarking A*B mod N, N has %u bits, %u loops\n",
+			bits, loops);
+	rand1024(N,bits); N[0]|=1;
+	rand1024(A,bits-1);
+	rand1024(B,bits-1);
+	mont_init1024(&M,N);
+
+	t=clock();
+	for (i=0; i<loops; i++) {
+		cpy1024(C,A);
+		mul1024modN(C,B,N);
+	}
+	t1 = 1.0*(clock()-t)/CLOCKS_PER_SEC/loops;
+
+	t=clock();
+	for (i=0; i<100*loops; i++) {
+		cpy1024(D,A);
+		to_mont1024(&M,D);
+		mont_mul1024(&M,D,B);
+	}
+	t2 = 1.0*(clock()-t)/CLOCKS_PER_SEC/loops/100;
+
+	printf("mul1024modN:  %10.3f us\n", 1e6*t1);
+	printf("mont_mul1024: %10.3f us (with to_mont1024)\n", 1e6*t2);
+	if (cmp1024(C,D)) puts("!! results differ !!");
+}
+
+/*
+ * the original mod_n: X = X mod N, bit by bit
+ */
+void mod_serial(uint1024 X, const uint1024 N) {
+	uint1024 m;
+
+	cpy1024(m,N);
+	while (cmp1024(m,X)<0) { shl1024(m,1); }
+
+	while (cmp1024(X,N)>=0) {
+		while (cmp1024(m,X)>0) { shr1024(m,1); }
+		sub1024(X,m);
+	}
+}
+
+/*
+ * T = Q*B + R, T has 2*(__SZ1024-1) digits
+ */
+void muladd_wide(uint64_t *T, const uint1024 Q, const uint1024 B,
+		const uint1024 R) {
+	unsigned __int128 t;
+	int i,j;
+
+	for (i=0; i<2*__SZ1024-2; i++) T[i] = (i<__SZ1024) ? R[i] : 0;
+	for (i=0; i<__SZ1024-1; i++) {
+		t=0;
+		for (j=0; i+j<2*__SZ1024-2; j++) {
+			t += (unsigned __int128) Q[i]*(j<__SZ1024?B[j]:0) + T[i+j];
+			T[i+j] = t; t>>=64;
+		}
+	}
+}
+
+/*
+ * checks divmod1024 and mod2048by1024 against Q*B+R, compares
+ * divmod1024 with mod_serial
+ */
+void bench_divmod(int ArgC, char *ArgV[]) {
+	unsigned int bits, loops, i;
+	uint64_t T[2*__SZ1024-2], U[2*__SZ1024-2];
+	uint1024 A[16],B[16],Q,R,S,one;
+	int k,bad;
+	clock_t t;
+	double t1,t2;
+
+	bits=650; loops=10;
+	if (ArgC>2) {
+		sscanf(ArgV[1], "%u", &bits);
+		sscanf(ArgV[2], "%u", &loops);
+	}
+
+	printf("Benchmarking A mod B, A has 1024 bits, B has %u..%u bits, "
+		"%u loops\n", bits-15, bits, loops);
+	for (k=0; k<16; k++) {
+		rand1024(A[k],1024);
+		rand1024(B[k],bits-k);
+	}
+
+	t=clock();
+	for (i=0; i<loops; i++)
+		for (k=0; k<16; k++) { cpy1024(R,A[k]); mod_serial(R,B[k]); }
+	t1 = 1.0*(clock()-t)/CLOCKS_PER_SEC/loops/16;
+
+	t=clock();
+	for (i=0; i<100*loops; i++)
+		for (k=0; k<16; k++) divmod1024(A[k],B[k],Q,S);
+	t2 = 1.0*(clock()-t)/CLOCKS_PER_SEC/loops/1600;
+
+	printf("mod_serial: %10.3f us\n", 1e6*t1);
+	printf("divmod1024: %10.3f us\n", 1e6*t2);
+
+	bad=0;
+	uint_to_1024(one,1);
+	for (k=0; k<16; k++) {
+		/* A = Q*B + R */
+		cpy1024(R,A[k]); mod_serial(R,B[k]);
+		divmod1024(A[k],B[k],Q,S);
+		if (cmp1024(R,S)) bad++;
+		muladd_wide(T,Q,B[k],S);
+		if (memcmp(T,A[k],sizeof(uint1024))) bad++;
+		for (i=__SZ1024; i<2*__SZ1024-2; i++) if (T[i]) bad++;
+
+		/* T = Q*B + R with Q of 1024 bits */
+		rand1024(Q,1024-k);
+		rand1024(S,bits-k-1);
+		muladd_wide(T,Q,B[k],S);
+		mod2048by1024(T,B[k],R);
+		if (cmp1024(R,S)) bad++;
+
+		/* divisor of one digit, quotient and remainder in place */
+		uint_to_1024(B[k],random()|1);
+		cpy1024(Q,A[k]); cpy1024(S,A[k]);
+		divmod1024(Q,B[k],Q,NULL);
+		divmod1024(S,B[k],NULL,S);
+		muladd_wide(U,Q,B[k],S);
+		if (memcmp(U,A[k],sizeof(uint64_t)*(__SZ1024-1))) bad++;
+
+	}
+	uint_to_1024(R,0);
+	if (divmod1024(A[0],R,Q,S)==0 || divmod1024(one,A[0],Q,S) ||
+			cmp1024(S,one) || non_zero1024(Q)) bad++;
+	if (bad) printf("!! %d results are wrong !!\n", bad);
+}
+
+/*
+ * the original GCD, repeated remainders through mod_serial
+ */
+void gcd_euclid(const uint1024 A, const uint1024 B, uint1024 G) {
+	uint1024 C,D;
+	if (cmp1024(A,B)>0) { cpy1024(C,A); cpy1024(D,B); }
+	else { cpy1024(C,B); cpy1024(D,A); }
+	
+	do {
+		cpy1024(G,C);
+		mod_serial(G,D);
+		
+		cpy1024(C,D);
+		cpy1024(D,G);
+	} while (non_zero1024(G));
+
+	cpy1024(G,C);
+}
+
+/*
+ * compares gcd_euclid, gcd1024 and gcd_lehmer1024
+ */
+void bench_gcd(int ArgC, char *ArgV[]) {
+	unsigned int bits, loops, i;
+	uint1024 A[64],B[64],G,H,N;
+	void (*f[3])(const uint1024, const uint1024, uint1024) =
+		{ gcd_euclid, gcd1024, gcd_lehmer1024 };
+	char *name[3] = { "euclid", "binary", "lehmer" };
+	int j,k,bad;
+	clock_t t;
+
+	bits=650; loops=10;
+	if (ArgC>2) {
+		sscanf(ArgV[1], "%u", &bits);
+		sscanf(ArgV[2], "%u", &loops);
+	}
+
+	printf("Benchmarking GCD of %u-bit numbers, %u loops\n", bits, loops);
+	rand1024(N,1020);
+	for (i=0; i<64; i++) {
+		rand1024(A[i],bits-32);
+		rand1024(B[i],bits-32-i);
+		uint_to_1024(G, (i%4)?1:random());	/* common factor */
+		mul1024modN(A[i],G,N);
+		mul1024modN(B[i],G,N);
+	}
+
+	for (j=0; j<3; j++) {
+		t=clock();
+		for (i=0; i<loops; i++)
+			for (k=0; k<64; k++) f[j](A[k],B[k],G);
+		printf("%s: %10.3f us\n", name[j],
+			1e6*(clock()-t)/CLOCKS_PER_SEC/loops/64);
+	}
+
+	bad=0;
+	for (k=0; k<64; k++) {
+		gcd_euclid(A[k],B[k],G);
+		for (j=1; j<3; j++) {
+			f[j](A[k],B[k],H);
+			if (cmp1024(G,H)) bad++;
+		}
+	}
+	if (bad) printf("!! %d results differ !!\n", bad);
+}
+
+/*
+ * the original find_u(), A = A^-1 (mod N) by extended Euclid with
+ * bit-serial remainders
+ */
+void inv_euclid(uint1024 V, const uint1024 M) {
+	uint1024 A[3][2];
+	uint1024 N;
+
+	uint_to_1024(A[0][0],0);
+	uint_to_1024(A[1][0],1);
+	cpy1024(A[0][1], M);
+	cpy1024(A[1][1], V);
+
+	while (non_zero1024(A[1][1])) {
+		cpy1024(A[2][0], A[1][0]);
+		cpy1024(A[2][1], A[1][1]);
+		
+		cpy1024(A[1][0], A[0][0]);
+		cpy1024(A[1][1], A[0][1]);
+		cpy1024(A[0][1], A[2][1]);
+		cpy1024(A[0][0], A[2][0]);
+
+#define mod(X,mm,Y,nn) \
+	cpy1024(N,mm); \
+	while (cmp1024(mm,X)<0) { shl1024(mm,1); shl1024(nn,1); }\
+\
+	while (cmp1024(X,N)>=0) {\
+		while (cmp1024(mm,X)>0) { shr1024(mm,1); shr1024(nn,1); }\
+		sub1024(X,mm);\
+		if (cmp1024(Y,nn)<0) add1024(Y,M); sub1024(Y,nn);\
+	}
+		
+		mod(A[1][1], A[2][1], A[1][0], A[2][0]);
+	}	
+
+	cpy1024(V, A[0][0]);
+}
+
+/*
+ * compares inv_euclid and inv1024modN
+ */
+void bench_inv(int ArgC, char *ArgV[]) {
+	unsigned int bits, loops, i;
+	uint1024 N,A[16],B,C,one;
+	int k,bad,diff;
+	clock_t t;
+	double t1,t2;
+
+	bits=650; loops=10;
+	if (ArgC>2) {
+		sscanf(ArgV[1], "%u", &bits);
+		sscanf(ArgV[2], "%u", &loops);
+	}
+
+	printf("Benchmarking A^-1 mod N, N has %u bits, %u loops\n",
+			bits, loops);
+	uint_to_1024(one,1);
+	rand1024(N,bits);
+	for (k=0; k<16; k++) {
+		do {
+			rand1024(A[k],bits-1-k);
+			gcd1024(A[k],N,B);
+		} while (cmp1024(B,one));
+	}
+
+	t=clock();
+	for (i=0; i<loops; i++)
+		for (k=0; k<16; k++) { cpy1024(B,A[k]); inv_euclid(B,N); }
+	t1 = 1.0*(clock()-t)/CLOCKS_PER_SEC/loops/16;
+
+	t=clock();
+	for (i=0; i<loops; i++)
+		for (k=0; k<16; k++) { cpy1024(C,A[k]); inv1024modN(C,N); }
+	t2 = 1.0*(clock()-t)/CLOCKS_PER_SEC/loops/16;
+
+	printf("inv_euclid:  %10.3f us\n", 1e6*t1);
+	printf("inv1024modN: %10.3f us\n", 1e6*t2);
+
+	bad=0; diff=0;
+	for (k=0; k<16; k++) {
+		cpy1024(B,A[k]); inv_euclid(B,N);
+		cpy1024(C,A[k]); inv1024modN(C,N);
+		if (cmp1024(B,C)) diff++;
+		mul1024modN(C,A[k],N);
+		if (cmp1024(C,one)) bad++;
+	}
+	if (diff) printf("inv_euclid differs in %d cases\n", diff);
+	if (bad) printf("!! %d results are wrong !!\n", bad);
+
+	/*
+	 * small operands go through the exact Lehmer pass alone, all of
+	 * them below 300 (e.g. 12^-1 mod 17 ends with y+C==0) and random
+	 * ones of up to 62 bits
+	 */
+	bad=0;
+	for (i=2; i<300; i++)
+		for (k=1; k<(int) i; k++) {
+			uint_to_1024(N,i); uint_to_1024(A[0],k);
+			gcd1024(A[0],N,B);
+			if (cmp1024(B,one)) continue;
+			cpy1024(C,A[0]);
+			if (inv1024modN(C,N) || cmp1024(C,N)>=0) { bad++; continue; }
+			mul1024modN(C,A[0],N);
+			if (cmp1024(C,one)) bad++;
+		}
+	for (i=0; i<10000; i++) {
+		rand1024(N, 2+i%61);
+		rand1024(A[0], 1+i%(1+i%61));
+		gcd1024(A[0],N,B);
+		if (cmp1024(B,one) || cmp1024(A[0],N)>=0) continue;
+		cpy1024(C,A[0]);
+		if (inv1024modN(C,N)) { bad++; continue; }
+		mul1024modN(C,A[0],N);
+		if (cmp1024(C,one)) bad++;
+	}
+	if (bad) printf("!! %d small inverses are wrong !!\n", bad);
+}
+
+#include "uintw.h"
+
+uint64_t rand64(void) {
+	return random() ^ ((uint64_t) random()<<22) ^ ((uint64_t) random()<<44);
+}
+
+/*
+ * checks mont_mulW against mulWmodN for width W
+ */
+#define test_width(W) { \
+	uint##W N,A,B,C; mont##W##_t M; unsigned int i; \
+	for (i=0; i<W/64; i++) { N[i]=rand64(); A[i]=rand64(); B[i]=rand64(); } \
+	N[i]=0; A[i]=0; B[i]=0; \
+	shr##W(N,2); N[0]|=1; shr##W(A,3); shr##W(B,3); \
+	cpy##W(C,A); mul##W##modN(C,B,N); \
+	mont_init##W(&M,N); to_mont##W(&M,A); mont_mul##W(&M,A,B); \
+	printf("%4u bits: %s\n", W, cmp##W(A,C)?"!! results differ !!":"ok"); }
+
+/*
+ * checks mont_mul1024 with A>=R, as a damaged 1056-bit block of a file,
+ * against (A mod N)*B mod N; mul1024modN alone reads 1024 bits of A
+ */
+void test_mont_range(void) {
+	uint1024 N,A,B,C; mont1024_t M; int i,k,bad=0;
+
+	for (k=0; k<100; k++) {
+		rand1024(N,650); N[0]|=1;
+		for (i=0; i<__SZ1024; i++) { A[i]=rand64(); B[i]=rand64(); }
+		A[__SZ1024-1] &= 0xffffffff; shr1024(A, k%64);
+		shr1024(B,__SZ1024*64-640);
+		divmod1024(A,N,0,C); mul1024modN(C,B,N);
+		mont_init1024(&M,N); to_mont1024(&M,B); mont_mul1024(&M,A,B);
+		bad += cmp1024(A,C)!=0;
+	}
+	printf("A>=R: %s\n", bad?"!! results differ !!":"ok");
+}
+
+void test_widths(void) {
+	puts("Testing Montgomery multiplication of all widths");
+	test_width(512);
+	test_width(1024);
+	test_width(2048);
+	test_width(4096);
+}
+
 int main(int ArgC, char *ArgV[]) {
 
 
@@ -436,6 +569,12 @@ int main(int ArgC, char *ArgV[]) {
 		printf("i=%d: ",i); dump1024(x);
 	}
 		
+	bench_mulmod(ArgC, ArgV);
+	bench_divmod(ArgC, ArgV);
+	test_widths();
+	test_mont_range();
+	bench_gcd(ArgC, ArgV);
+	bench_inv(ArgC, ArgV);
 //	test_GCD(ArgC, ArgV);
 //	test_mulmod(ArgC, ArgV);
 /*
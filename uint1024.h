@@ -28,79 +28,23 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#define __SZ1024 33
-
-typedef 
-	uint32_t uint1024[__SZ1024];
-
-int 	read1024	( FILE *stream, uint1024 x );
-int	write1024	( FILE *stream, const uint1024 x );
-		/*
-		 * reads/writes x from/to stream
-		 * return non-zero if failed
-		 */
-
-	
-int8_t	add1024 	( uint1024 A, const uint1024 B );  
-		/*
-		*  A += B 
-		*  returns 1 if A>2^1024 
-		*/
-
-
-int8_t	sub1024 	( uint1024 A, const uint1024 B );  
-		/*
-		*  A -= B 
-		*  returns 1 if A<0 
-		*/
-
-void mul1024modN	( uint1024 A, const uint1024 B , const uint1024 N);
-		/*
-		 * A *= B (mod N)
-		 */
-
-
-void  	shr1024 	( uint1024 A, uint16_t s );
-		/*  
-		*  A = A >> s 
-		*/
-
-
-void  	shl1024 	( uint1024 A, uint16_t s );
-		/*  
-		*  A = A << s 
-		*/
-
-
-int8_t	zero1024	( const uint1024 A );
-		/*
-		*  returns 1 if A=0, 0 otherwise
-		*/
+#define __SZ1024 17
+	/* 16 64-bit digits + 1 guard digit */
+#define __SZ1024_32 33
+	/* number of 32-bit words of uint1024 in files */
+
+/*
+ * uint1024 and its routines (add1024, mul1024modN, mont_mul1024 ...)
+ * are the 1024-bit instantiation of uintN.h, see there
+ */
+#define UINT_BITS 1024
+#include "uintN.h"
+#undef UINT_BITS
 
 #define non_zero1024(A) (!zero1024(A))
 
-void	cpy1024		( uint1024 A, const uint1024 B );
-		/*
-		 * A = B
-		 */
-
-void
-	uint_to_1024	( uint1024 D, const  unsigned int A );
-		/* 
-		 * returns A as uint1024 
-		 */
-
-int
-	cmp1024		( const uint1024 A, const uint1024 B );
-		/*
-		 * compares A and B, returns -1 if A<B, 0 if equal and +1 if
-		 * A>B
-		 */
-
-void	dump1024	( const uint1024 A );
-		/*
-		 * dumps A as array of uints
-		 */
+#define mod2048by1024	mod2x1024
+	/* R = A mod N for a 2048-bit A (32 digits) */
 
 void	GCD		( const uint1024 A, const uint1024 B, uint1024 G );
 		/* 
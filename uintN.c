@@ -0,0 +1,785 @@
+/***************************************************************************    
+*   Knapsack problem solving encryption - asymetric encryption based on
+*   NP-complete problem (Knapsack)
+*   Copyright (C) 2001 Miroslav 'Mirco' Bajtos
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA,
+*   or try <http://www.gnu.org>
+***************************************************************************/
+
+/*
+ * fixed-width unsigned integers - template implementation
+ *
+ * define UINT_BITS and include this file once per width, after the
+ * declarations from uintN.h for the same width
+ */
+
+#ifndef UINT_BITS
+#error "UINT_BITS must be defined before including uintN.c"
+#endif
+
+#ifndef __UINTN_C__
+#define __UINTN_C__
+
+#include <inttypes.h>
+#include <string.h>
+
+typedef unsigned __int128 uint128_t;
+
+#define digitsN		_UINT_CAT(digits,UINT_BITS,)
+#define mont_finN	_UINT_CAT(mont_fin,UINT_BITS,)
+#define ctzN		_UINT_CAT(ctz,UINT_BITS,)
+#define top62N		_UINT_CAT(top62_,UINT_BITS,)
+#define lehmer_stepN	_UINT_CAT(lehmer_step,UINT_BITS,)
+#define lehmer_absN	_UINT_CAT(lehmer_abs,UINT_BITS,)
+
+/*
+ * loops over whole numbers have constant trip counts, let them be
+ * unrolled completely at every width
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define UNROLL		_Pragma("GCC unroll 72")
+#else
+#define UNROLL
+#endif
+
+/*
+ * simulates Euclid's steps on x,y (leading bits of a,b) as long as
+ * quotients are sure to be right for a,b; with exact set x,y are
+ * a,b themselves and Euclid runs to the end
+ * cofactors go to T[] = {A,B,C,D}, returns number of steps
+ */
+static int lehmer_sim ( int64_t x, int64_t y, int exact, int64_t T[4] ) {
+	int64_t A=1,B=0,C=0,D=1,q,r;
+	int n=0;
+
+	while (exact ? y : (y+C && y+D)) {
+		q = exact ? x/y : (x+A)/(y+C);
+		if (!exact && q != (x+B)/(y+D)) break;
+		r=A-q*C; A=C; C=r;
+		r=B-q*D; B=D; D=r;
+		r=x-q*y; x=y; y=r;
+		n++;
+	}
+
+	T[0]=A; T[1]=B; T[2]=C; T[3]=D;
+	return(n);
+}
+
+/*
+ * Knuth's Algorithm D (TAOCP vol. 2, 4.3.1) on 64-bit digits
+ *
+ * U has m digits, V has n digits, m>=n, V[n-1]!=0
+ * Q gets m-n+1 digits of U/V, R gets n digits of U%V, either may
+ * be NULL
+ */
+static void knuth_div ( const uint64_t *U, int m, const uint64_t *V, int n,
+		uint64_t *Q, uint64_t *R ) {
+	uint64_t u[m+1], v[n], qh, c, b, x, lo;
+	uint128_t num, rh, p;
+	int i,j,d;
+
+	if (n==1) {
+		/* short division */
+		rh=0;
+		for (j=m-1; j>=0; j--) {
+			rh = (rh<<64) | U[j];
+			if (Q) Q[j] = rh / V[0];
+			rh %= V[0];
+		}
+		if (R) R[0] = rh;
+		return;
+	}
+
+	/* D1: normalize, so that the top bit of v is set */
+	d = __builtin_clzll(V[n-1]);
+	for (i=n-1; i>0; i--)
+		v[i] = d ? (V[i]<<d) | (V[i-1]>>(64-d)) : V[i];
+	v[0] = V[0]<<d;
+	u[m] = d ? U[m-1]>>(64-d) : 0;
+	for (i=m-1; i>0; i--)
+		u[i] = d ? (U[i]<<d) | (U[i-1]>>(64-d)) : U[i];
+	u[0] = U[0]<<d;
+
+	for (j=m-n; j>=0; j--) {
+		/* D3: estimate qh from the top two digits, at most 2 too big */
+		num = ((uint128_t) u[j+n]<<64) | u[j+n-1];
+		p = num / v[n-1];
+		rh = num - p*v[n-1];
+		while ((p>>64) || p*v[n-2] > ((rh<<64) | u[j+n-2])) {
+			p--; rh += v[n-1];
+			if (rh>>64) break;
+		}
+		qh = p;
+
+		/* D4: u[j..j+n] -= qh*v */
+		c=0; b=0;
+		for (i=0; i<n; i++) {
+			p = (uint128_t) qh*v[i] + c;
+			c = p>>64; lo = p;
+			x = u[i+j];
+			u[i+j] = x - lo - b;
+			b = (x<lo) || (x-lo<b);
+		}
+		x = u[j+n];
+		u[j+n] = x - c - b;
+		b = (x<c) || (x-c<b);
+
+		/* D6: rarely qh was still one too big, add v back */
+		if (b) {
+			qh--; c=0;
+			for (i=0; i<n; i++) {
+				p = (uint128_t) u[i+j] + v[i] + c;
+				u[i+j] = p; c = p>>64;
+			}
+			u[j+n] += c;
+		}
+		if (Q) Q[j] = qh;
+	}
+
+	/* D8: unnormalize the remainder */
+	if (R) {
+		for (i=0; i<n-1; i++)
+			R[i] = d ? (u[i]>>d) | (u[i+1]<<(64-d)) : u[i];
+		R[n-1] = u[n-1]>>d;
+	}
+}
+
+#endif /* __UINTN_C__ */
+
+
+/*
+ * representation of uintN: u[0] is the lowest 'digit',
+ * u[SZN-2] is the highest 'digit', u[SZN-1] is
+ * used to catch overflows
+ *
+ * 'digits' are 64 bits wide, carries are propagated through
+ * 128-bit temporaries; files keep SZN_32 32-bit words
+ */
+
+
+/*
+ *  A += B 
+ *  returns 1 if A>2^UINT_BITS 
+ */
+int8_t	addN 	( uintN A, const uintN B )  
+{
+	int i;
+	uint128_t c;
+
+	c=0;
+	UNROLL
+	for (i=0; i<SZN-1; i++) {
+		c += (uint128_t) A[i] + B[i];
+		A[i] = c; c>>=64;
+	}
+	A[SZN-1] += c;
+ 
+	i = A[SZN-1]?1:0;
+	A[SZN-1] = 0;
+	
+	return (i);
+	
+}
+	
+
+/*
+ *  A -= B 
+ *  returns 1 if A<0 
+ */
+int8_t	subN 	( uintN A, const uintN B )  
+{
+	int i;
+	uint128_t r;
+
+	
+	r=0;
+	UNROLL
+	for (i=0; i<SZN; i++) {
+		r = (uint128_t) A[i] - B[i] - r;
+		A[i] = r;
+		r = (r>>64) & 1;
+	}
+	if (r) A[SZN-1] = 0;
+
+	return (r);
+	
+}
+
+/*
+ * number of significant digits of A (all SZN of them count)
+ */
+static int digitsN ( const uint64_t *A, int n ) {
+	while (n && !A[n-1]) n--;
+	return(n);
+}
+
+int divmodN ( const uintN A, const uintN B, uintN Q, uintN R ) {
+	uint64_t q[SZN], r[SZN];
+	int m,n,i;
+
+	n = digitsN(B,SZN);
+	if (!n) return(1);
+	m = digitsN(A,SZN);
+
+	for (i=0; i<SZN; i++) { q[i]=0; r[i]=0; }
+	if (m<n) { for (i=0; i<m; i++) r[i]=A[i]; }
+	else knuth_div(A,m,B,n,q,r);
+
+	if (Q) cpyN(Q,q);
+	if (R) cpyN(R,r);
+	return(0);
+}
+
+void mod2xN ( const uint64_t A[2*SZN-2], const uintN N, uintN R ) {
+	int m,n,i;
+
+	n = digitsN(N,SZN);
+	m = digitsN(A,2*SZN-2);
+
+	uint_to_N(R,0);
+	if (m<n) { for (i=0; i<m; i++) R[i]=A[i]; }
+	else knuth_div(A,m,N,n,NULL,R);
+}
+
+/*
+ * A *= B (mod N)
+ */
+void mulNmodN	( uintN A, const uintN B , const uintN N) {
+	uint64_t T[2*SZN-2];
+	uint128_t t;
+	int i,j;
+
+	for (i=0; i<2*SZN-2; i++) T[i]=0;
+	for (i=0; i<SZN-1; i++) {
+		t=0;
+		for (j=0; j<SZN-1; j++) {
+			t += (uint128_t) A[j] * B[i] + T[i+j];
+			T[i+j] = t; t>>=64;
+		}
+		T[i+SZN-1] = t;
+	}
+	mod2xN(T,N,A);
+}
+
+/*
+ * Montgomery multiplication
+ */
+
+/*
+ * A = T-N if T>=N, T otherwise; T has s+1 digits, result fits in s
+ */
+static void mont_finN ( const montN_t *M, uintN A, const uint64_t *T ) {
+	int i;
+	uint128_t b;
+
+	i=M->s;
+	if (!T[i])
+		for (i--; i>=0; i--)
+			if (T[i]!=M->n[i]) break;
+
+	if (i<0 || i==M->s || T[i]>M->n[i]) {
+		b=0;
+		for (i=0; i<M->s; i++) {
+			b = (uint128_t) T[i] - M->n[i] - b;
+			A[i] = b;
+			b = (b>>64)&1;
+		}
+	} else
+		for (i=0; i<M->s; i++) A[i]=T[i];
+
+	for (i=M->s; i<SZN; i++) A[i]=0;
+}
+
+/*
+ * A = A*B/R (mod N)
+ */
+void mont_mulN ( const montN_t *M, uintN A, const uintN B ) {
+	uint64_t T[SZN+2], q;
+	uint128_t c;
+	int i,j,s=M->s;
+
+	/* only s digits of A are read, A>=R (damaged ciphertext) is reduced */
+	for (i=s; i<SZN && !A[i]; i++);
+	if (i<SZN) divmodN(A,M->n,0,A);
+
+	for (i=0; i<s+2; i++) T[i]=0;
+
+	for (i=0; i<s; i++) {
+		c=0;
+		for (j=0; j<s; j++) {
+			c += (uint128_t) A[j]*B[i] + T[j];
+			T[j] = c; c>>=64;
+		}
+		c += T[s]; T[s]=c; T[s+1]=c>>64;
+
+		q = T[0]*M->n0;
+		c = ((uint128_t) q*M->n[0] + T[0]) >> 64;
+		for (j=1; j<s; j++) {
+			c += (uint128_t) q*M->n[j] + T[j];
+			T[j-1] = c; c>>=64;
+		}
+		c += T[s]; T[s-1]=c; T[s]=T[s+1]+(c>>64);
+	}
+
+	mont_finN(M,A,T);
+}
+
+/*
+ * prepares M for modulus N, returns non-zero if N is even
+ */
+int mont_initN ( montN_t *M, const uintN N ) {
+	uint64_t T[SZN+2], x, c;
+	int i,j;
+
+	if (!(N[0]&1)) return(1);
+
+	cpyN(M->n,N);
+
+	for (i=SZN-1; !N[i]; i--);
+	M->s = (i+2<SZN)?i+2:SZN;
+
+	/* Newton iteration, every step doubles the number of valid bits */
+	x = N[0];
+	for (i=0; i<5; i++) x *= 2-N[0]*x;
+	M->n0 = -x;
+
+	/* R^2 mod N by doubling 1 (mod N) 2*64*s times */
+	uint_to_N(M->rr,1);
+	for (i=0; i<128*M->s; i++) {
+		c=0;
+		for (j=0; j<M->s; j++) {
+			T[j] = (M->rr[j]<<1) | c;
+			c = M->rr[j]>>63;
+		}
+		T[M->s]=c;
+		mont_finN(M,M->rr,T);
+	}
+
+	return(0);
+}
+
+/*
+ * A = A*R (mod N)
+ */
+void to_montN ( const montN_t *M, uintN A ) {
+	mont_mulN(M,A,M->rr);
+}
+
+/*
+ * A = A/R (mod N)
+ */
+void from_montN ( const montN_t *M, uintN A ) {
+	uintN one;
+
+	uint_to_N(one,1);
+	mont_mulN(M,A,one);
+}
+
+
+
+
+
+/*  
+ *  A = A >> s 
+ */
+void  	shrN 	( uintN A, uint16_t s )
+{
+	int i;
+	uint64_t r,r2;
+	
+	r=s/64;
+	if (r) {
+		if (r>SZN) r=SZN;
+		for (i=0; i<SZN-r; i++) A[i]=A[i+r];
+		for (i=SZN-r; i<SZN; i++) A[i]=0;
+		s%=64;
+	}
+	
+	if (s) {
+		r=0;
+		UNROLL
+		for (i=SZN-1; i>=0; i--) {
+			r2 = A[i] & ((((uint64_t) 1) << s) -1);
+			A[i] = (A[i] >> s) + (r << (64-s));
+			r = r2;
+		}
+	}
+}
+
+
+/*  
+ *  A = A << s 
+ */
+void  	shlN 	( uintN A, uint16_t s )
+{
+	int i;
+	uint64_t r,r2;
+
+#if DSHLN
+	printf("Debugging shlN(s=%hu)\n",s);
+	printf("A="); dumpN(A);
+#endif
+	
+	r=s/64;
+	if (r) {
+		if (r>SZN) r=SZN;
+		for (i=SZN-1; i>=r; i--) A[i]=A[i-r];
+		for (i=0; i<r; i++) A[i]=0;
+		s%=64;
+	}
+	
+	#if DSHLN
+		printf("s=%hu",s);
+	#endif
+
+	if (s) {
+		r=0;
+		UNROLL
+		for (i=0; i<SZN; i++) {
+			r2 = A[i] >> (64-s);
+			A[i] = (A[i] << s) + r;
+			r = r2;
+			#if DSHLN
+				dumpN(A);
+			#endif
+		}
+	}
+	
+	#if DSHLN
+		puts("leaving shlN");
+	#endif
+}
+
+int
+	cmpN		( const uintN A, const uintN B )
+{
+	int i=SZN-1;
+
+	UNROLL
+	while (i>=0) 
+		if (A[i]<B[i]) return(-1);
+		else if (A[i]>B[i]) return (1);
+		else i--;
+	return(0);
+}
+
+
+/*
+ *  returns 1 if A=0, 0 otherwise
+ */
+int8_t	zeroN	( const uintN A )
+{
+	int i;
+	
+	UNROLL
+	for (i=0; i<SZN; i++)
+		if ( A[i] ) return (0);
+
+	return (1);
+
+}
+
+/* 
+ * converts A as uint32_t to D as uintN
+ */
+void  uint_to_N	( uintN D, const uint32_t A ) {
+	int i;
+		
+	UNROLL
+	for (i=0; i<SZN; i++)
+		D[i] = 0;
+	D[0] = A;
+	
+
+}
+
+
+/*
+ * A = B
+ */
+void	cpyN		( uintN A, const uintN B ) {
+	int i;
+
+	UNROLL
+	for (i=0; i<SZN; i++)
+		A[i]=B[i];
+
+}
+
+/*
+ * dumps A as array of uints
+ */
+void dumpN	(const uintN A)
+{
+	int i;
+	for (i=0; i<SZN; i++) 
+		printf("%" PRIu64 " ",A[i]);
+	puts("\n");
+}
+
+
+/*
+ * returns number of significant bits of A
+ */
+int	bitsN	( const uintN A ) {
+	int i;
+
+	for (i=SZN-1; i>=0; i--)
+		if (A[i]) return (64*i + 64 - __builtin_clzll(A[i]));
+	return (0);
+}
+
+/*
+ * returns number of trailing zero bits of A, A!=0
+ */
+static int ctzN ( const uintN A ) {
+	int i;
+
+	for (i=0; !A[i]; i++);
+	return (64*i + __builtin_ctzll(A[i]));
+}
+
+/* 
+ * finds the GCD of A and B and result stores in G
+ *
+ * binary (Stein's) algorithm: the common power of two is taken out
+ * once, then the smaller odd number is subtracted from the larger
+ * one and all trailing zeros are shifted out at once
+ */
+void gcdN(const uintN A, const uintN B, uintN G) {
+	uintN C,T;
+	int k;
+
+	if (zeroN(A)) { cpyN(G,B); return; }
+	if (zeroN(B)) { cpyN(G,A); return; }
+
+	cpyN(G,A); cpyN(C,B);
+	k = ctzN(G);
+	if (ctzN(C)<k) k=ctzN(C);
+	shrN(G,ctzN(G));
+
+	/* G is odd */
+	do {
+		shrN(C,ctzN(C));
+		if (cmpN(G,C)>0) { cpyN(T,G); cpyN(G,C); cpyN(C,T); }
+		subN(C,G);
+	} while (!zeroN(C));
+
+	shlN(G,k);
+}
+
+/*
+ * Lehmer's algorithm: Euclid's steps are simulated on 62 leading
+ * bits of both numbers (with 64-bit cofactors A,B,C,D) as long as
+ * quotients are sure to be right, then applied to the whole numbers
+ * at once
+ */
+
+/*
+ * returns 62 bits of A starting at bit n-62
+ */
+static int64_t top62N ( const uintN A, int n ) {
+	int i,o;
+	uint64_t x;
+
+	if (n<=62) return(A[0]);
+	n-=62; i=n/64; o=n%64;
+	x = A[i]>>o;
+	if (o && i+1<SZN) x |= A[i+1] << (64-o);
+	return (x & ((((uint64_t) 1) << 62) - 1));
+}
+
+/*
+ * (a,b) = (A*a + B*b, C*a + D*b)
+ */
+static void lehmer_stepN ( uintN a, uintN b,
+		int64_t A, int64_t B, int64_t C, int64_t D ) {
+	__int128 s,t;
+	int i;
+
+	s=0; t=0;
+	for (i=0; i<SZN; i++) {
+		s += (__int128) A*a[i] + (__int128) B*b[i];
+		t += (__int128) C*a[i] + (__int128) D*b[i];
+		a[i] = s; s >>= 64;
+		b[i] = t; t >>= 64;
+	}
+}
+
+/*
+ * (x,y) = (|A|*x + |B|*y, |C|*x + |D|*y)
+ *
+ * Euclid's cofactors alternate in sign, so do A,B and C,D; keeping
+ * only magnitudes of cofactors, the products always add up
+ */
+static void lehmer_absN ( uintN x, uintN y, const int64_t T[4] ) {
+	uint64_t A,B,C,D;
+	uint128_t s,t;
+	int i;
+
+	A = (T[0]<0)?-T[0]:T[0];
+	B = (T[1]<0)?-T[1]:T[1];
+	C = (T[2]<0)?-T[2]:T[2];
+	D = (T[3]<0)?-T[3]:T[3];
+
+	s=0; t=0;
+	for (i=0; i<SZN; i++) {
+		s += (uint128_t) A*x[i] + (uint128_t) B*y[i];
+		t += (uint128_t) C*x[i] + (uint128_t) D*y[i];
+		x[i] = s; s >>= 64;
+		y[i] = t; t >>= 64;
+	}
+}
+
+void gcd_lehmerN(const uintN X, const uintN Y, uintN G) {
+	uintN a,b,t;
+	int64_t T[4];
+	uint128_t m;
+	uint64_t u,v;
+	int i,n;
+
+	if (cmpN(X,Y)>=0) { cpyN(a,X); cpyN(b,Y); }
+	else { cpyN(a,Y); cpyN(b,X); }
+
+	/* a>=b */
+	while (bitsN(b)>64) {
+		n = bitsN(a);
+		lehmer_sim(top62N(a,n), top62N(b,n), 0, T);
+
+		if (!T[1]) {
+			/* quotient too big for leading bits, full step */
+			divmodN(a,b,NULL,t);
+			cpyN(a,b); cpyN(b,t);
+		} else
+			lehmer_stepN(a,b,T[0],T[1],T[2],T[3]);
+	}
+
+	/* b fits in one digit */
+	uint_to_N(G,0);
+	if (!b[0]) { cpyN(G,a); return; }
+
+	m=0;
+	for (i=SZN-1; i>=0; i--) m = ((m<<64) | a[i]) % b[0];
+	u=b[0]; v=m;
+	while (v) { m=u%v; u=v; v=m; }
+	G[0]=u;
+}
+
+/*
+ * A = A^-1 (mod N)
+ *
+ * extended Lehmer: a,b run as in gcd_lehmerN starting from N,A;
+ * x1,x2 are magnitudes of their cofactors of A, the true cofactor
+ * of a is (-1)^(k+1)*x1 after k Euclid's steps
+ */
+int invNmodN ( uintN A, const uintN N ) {
+	uintN a,b,x1,x2,q,t;
+	uint128_t c;
+	int64_t T[4];
+	int i,j,n,s,k;
+
+	if (divmodN(A,N,NULL,b)) return(1);
+	cpyN(a,N);
+	uint_to_N(x1,0);
+	uint_to_N(x2,1);
+	k=0;
+
+	while (!zeroN(b)) {
+		n = bitsN(a);
+		s = lehmer_sim(top62N(a,n), top62N(b,n), n<=62, T);
+
+		if (T[1]) {
+			lehmer_stepN(a,b,T[0],T[1],T[2],T[3]);
+			lehmer_absN(x1,x2,T);
+			k += s;
+			continue;
+		}
+
+		/* full step: a = a mod b, x1 += [a/b]*x2 (fits, it's <=N) */
+		divmodN(a,b,q,t);
+		for (i=0; i<SZN; i++) {
+			c=0;
+			if (q[i]) for (j=0; i+j<SZN; j++) {
+				c += (uint128_t) q[i]*x2[j] + x1[i+j];
+				x1[i+j] = c; c >>= 64;
+			}
+		}
+		cpyN(a,b); cpyN(b,t);
+		cpyN(t,x1); cpyN(x1,x2); cpyN(x2,t);
+		k++;
+	}
+
+	/* a = GCD(A,N) */
+	uint_to_N(t,1);
+	if (cmpN(a,t)) return(1);
+
+	if (k&1) cpyN(A,x1);
+	else { cpyN(A,N); subN(A,x1); }
+	return(0);
+}
+
+
+/*
+ * converts x from/to 32-bit words in buf
+ */
+void	loadN	( const void *buf, uintN x ) {
+	uint32_t w[2*SZN];
+	int i;
+
+	memcpy(w, buf, 4*SZN_32);
+	w[SZN_32] = 0;
+	for (i=0; i<SZN; i++)
+		x[i] = w[2*i] | ((uint64_t) w[2*i+1]) << 32;
+}
+
+void	storeN	( void *buf, const uintN x ) {
+	uint32_t w[2*SZN];
+	int i;
+
+	for (i=0; i<SZN; i++) {
+		w[2*i] = x[i];
+		w[2*i+1] = x[i] >> 32;
+	}
+	memcpy(buf, w, 4*SZN_32);
+}
+
+/*
+ * reads/writes x from/to stream
+ * return non-zero if failed
+ */
+int 	readN	( FILE *stream, uintN x ) {
+	uint32_t w[SZN_32];
+
+	if (fread(w, 32/8, SZN_32, stream) != SZN_32) return(1);
+	loadN(w, x);
+	return(0);
+}
+int	writeN	( FILE *stream, const uintN x ) {
+	uint32_t w[SZN_32];
+
+	storeN(w, x);
+	return ( fwrite(w, 32/8, SZN_32, stream) != SZN_32 );
+}
+int 	readNn	( FILE *stream, uintN *x, int n ) {
+	while (n--)
+		if (readN(stream, *x++)) return(1);
+	return(0);
+}
+int	writeNn	( FILE *stream, const uintN *x, int n ) {
+	while (n--)
+		if (writeN(stream, *x++)) return(1);
+	return(0);
+}
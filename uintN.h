@@ -0,0 +1,238 @@
+/***************************************************************************    
+*   Knapsack problem solving encryption - asymetric encryption based on
+*   NP-complete problem (Knapsack)
+*   Copyright (C) 2001 Miroslav 'Mirco' Bajtos
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA,
+*   or try <http://www.gnu.org>
+***************************************************************************/
+
+/*
+ * fixed-width unsigned integers - template
+ *
+ * define UINT_BITS (multiple of 64) and include this file once per
+ * width, e.g. UINT_BITS 1024 declares uint1024, add1024, mul1024modN ...
+ * (see uint1024.h); uintN.c holds the matching implementation
+ */
+
+#ifndef UINT_BITS
+#error "UINT_BITS must be defined before including uintN.h"
+#endif
+
+#ifndef __UINTN_H__
+#define __UINTN_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define __UINT_CAT(a,b,c)	a##b##c
+#define _UINT_CAT(a,b,c)	__UINT_CAT(a,b,c)
+
+/*
+ * names of the current instantiation
+ */
+#define SZN		(UINT_BITS/64+1)	/* 64-bit digits + 1 guard */
+#define SZN_32		(UINT_BITS/32+1)	/* 32-bit words in files */
+
+#define uintN		_UINT_CAT(uint,UINT_BITS,)
+#define montN_t		_UINT_CAT(mont,UINT_BITS,_t)
+
+#define loadN		_UINT_CAT(load,UINT_BITS,)
+#define storeN		_UINT_CAT(store,UINT_BITS,)
+#define readN		_UINT_CAT(read,UINT_BITS,)
+#define writeN		_UINT_CAT(write,UINT_BITS,)
+#define readNn		_UINT_CAT(read,UINT_BITS,n)
+#define writeNn		_UINT_CAT(write,UINT_BITS,n)
+#define addN		_UINT_CAT(add,UINT_BITS,)
+#define subN		_UINT_CAT(sub,UINT_BITS,)
+#define mulNmodN	_UINT_CAT(mul,UINT_BITS,modN)
+#define divmodN		_UINT_CAT(divmod,UINT_BITS,)
+#define mod2xN		_UINT_CAT(mod2x,UINT_BITS,)
+#define invNmodN	_UINT_CAT(inv,UINT_BITS,modN)
+#define shrN		_UINT_CAT(shr,UINT_BITS,)
+#define shlN		_UINT_CAT(shl,UINT_BITS,)
+#define zeroN		_UINT_CAT(zero,UINT_BITS,)
+#define cpyN		_UINT_CAT(cpy,UINT_BITS,)
+#define uint_to_N	_UINT_CAT(uint_to_,UINT_BITS,)
+#define cmpN		_UINT_CAT(cmp,UINT_BITS,)
+#define dumpN		_UINT_CAT(dump,UINT_BITS,)
+#define gcdN		_UINT_CAT(gcd,UINT_BITS,)
+#define gcd_lehmerN	_UINT_CAT(gcd_lehmer,UINT_BITS,)
+#define bitsN		_UINT_CAT(bits,UINT_BITS,)
+#define mont_initN	_UINT_CAT(mont_init,UINT_BITS,)
+#define mont_mulN	_UINT_CAT(mont_mul,UINT_BITS,)
+#define to_montN	_UINT_CAT(to_mont,UINT_BITS,)
+#define from_montN	_UINT_CAT(from_mont,UINT_BITS,)
+
+#endif /* __UINTN_H__ */
+
+
+typedef
+	uint64_t uintN[SZN];
+
+void	loadN		( const void *buf, uintN x );
+void	storeN		( void *buf, const uintN x );
+		/*
+		 * converts x from/to SZN_32 32-bit words in buf, the same
+		 * layout as in files
+		 */
+
+int 	readN		( FILE *stream, uintN x );
+int	writeN		( FILE *stream, const uintN x );
+		/*
+		 * reads/writes x from/to stream
+		 * return non-zero if failed
+		 */
+
+int 	readNn		( FILE *stream, uintN *x, int n );
+int	writeNn		( FILE *stream, const uintN *x, int n );
+		/*
+		 * reads/writes array of n numbers
+		 * return non-zero if failed
+		 */
+
+
+int8_t	addN	 	( uintN A, const uintN B );
+		/*
+		*  A += B
+		*  returns 1 if A>2^UINT_BITS
+		*/
+
+
+int8_t	subN	 	( uintN A, const uintN B );
+		/*
+		*  A -= B
+		*  returns 1 if A<0
+		*/
+
+void	mulNmodN	( uintN A, const uintN B , const uintN N);
+		/*
+		 * A *= B (mod N)
+		 * A,B<2^UINT_BITS, the full product is reduced by mod2xN
+		 */
+
+int	divmodN		( const uintN A, const uintN B, uintN Q, uintN R );
+		/*
+		 * Q = A/B, R = A%B (Knuth's Algorithm D on 64-bit digits)
+		 * Q or R may be NULL or alias A,B
+		 * returns non-zero if B=0
+		 */
+
+void	mod2xN		( const uint64_t A[2*SZN-2], const uintN N, uintN R );
+		/*
+		 * R = A mod N, A is a double-width number of 2*(SZN-1)
+		 * digits (e.g. a product of two uintN), N!=0
+		 */
+
+int	invNmodN	( uintN A, const uintN N );
+		/*
+		 * A = A^-1 (mod N)
+		 * returns non-zero if A has no inverse
+		 */
+
+
+void  	shrN	 	( uintN A, uint16_t s );
+		/*
+		*  A = A >> s
+		*/
+
+
+void  	shlN	 	( uintN A, uint16_t s );
+		/*
+		*  A = A << s
+		*/
+
+
+int8_t	zeroN		( const uintN A );
+		/*
+		*  returns 1 if A=0, 0 otherwise
+		*/
+
+void	cpyN		( uintN A, const uintN B );
+		/*
+		 * A = B
+		 */
+
+void
+	uint_to_N	( uintN D, const  unsigned int A );
+		/*
+		 * returns A as uintN
+		 */
+
+int
+	cmpN		( const uintN A, const uintN B );
+		/*
+		 * compares A and B, returns -1 if A<B, 0 if equal and +1 if
+		 * A>B
+		 */
+
+void	dumpN		( const uintN A );
+		/*
+		 * dumps A as array of uints
+		 */
+
+int	bitsN		( const uintN A );
+		/*
+		 * returns number of significant bits of A
+		 */
+
+void	gcdN		( const uintN A, const uintN B, uintN G );
+		/*
+		 * finds the GCD of A and B and result stores in G
+		 * (binary algorithm)
+		 */
+
+void	gcd_lehmerN	( const uintN A, const uintN B, uintN G );
+		/*
+		 * the same as gcdN, using Lehmer's algorithm
+		 */
+
+
+/*
+ * Montgomery arithmetic modulo fixed odd N
+ *
+ * R = 2^(64*s), where s is one digit more than N needs, so anything
+ * smaller than 2^64*N (e.g. sum of all ITEMS public key items) may be
+ * passed as the first operand of mont_mulN without prior reduction
+ */
+typedef struct {
+	uintN		n;	/* modulus */
+	uintN		rr;	/* R^2 mod n */
+	uint64_t	n0;	/* -n^-1 mod 2^64 */
+	uint8_t		s;	/* number of digits of R */
+} montN_t;
+
+int	mont_initN	( montN_t *M, const uintN N );
+		/*
+		 * prepares M for modulus N
+		 * returns non-zero if N is even (Montgomery can't be used)
+		 */
+
+void	mont_mulN	( const montN_t *M, uintN A, const uintN B );
+		/*
+		 * A = A*B/R (mod N)
+		 * B<N, A<R is multiplied as it is, A>=R is reduced mod N
+		 * first
+		 */
+
+void	to_montN	( const montN_t *M, uintN A );
+		/*
+		 * A = A*R (mod N), A<R
+		 */
+
+void	from_montN	( const montN_t *M, uintN A );
+		/*
+		 * A = A/R (mod N), A<R
+		 */
@@ -0,0 +1,42 @@
+/***************************************************************************    
+*   Knapsack problem solving encryption - asymetric encryption based on
+*   NP-complete problem (Knapsack)
+*   Copyright (C) 2001 Miroslav 'Mirco' Bajtos
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA,
+*   or try <http://www.gnu.org>
+***************************************************************************/
+
+#ifndef __UINTW_H__
+#define __UINTW_H__
+
+/*
+ * other instantiations of uintN.h, for keys of different size:
+ * uint512, uint2048 and uint4096 (uint1024 lives in uint1024.h)
+ */
+
+#define UINT_BITS 512
+#include "uintN.h"
+#undef UINT_BITS
+
+#define UINT_BITS 2048
+#include "uintN.h"
+#undef UINT_BITS
+
+#define UINT_BITS 4096
+#include "uintN.h"
+#undef UINT_BITS
+
+#endif /* uintw.h */